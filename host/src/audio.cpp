@@ -20,7 +20,12 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+
 #include "audio.h"
+#include "tracer.h"
+#include "perfcounters.h"
+#include "rtcheck.h"
 
 int _process(jack_nframes_t nframes, void *arg)
 {
@@ -28,8 +33,38 @@ int _process(jack_nframes_t nframes, void *arg)
 	return _this->process(nframes);
 }
 
+void _latency(jack_latency_callback_mode_t mode, void *arg)
+{
+	auto _this = static_cast<audio *>(arg);
+	_this->latency(mode);
+}
+
+int _buffersize(jack_nframes_t nframes, void *arg)
+{
+	auto _this = static_cast<audio *>(arg);
+	return _this->buffersize_changed(nframes);
+}
+
+int _xrun(void *arg)
+{
+	auto _this = static_cast<audio *>(arg);
+	return _this->xrun();
+}
+
+void _thread_init(void *)
+{
+	trace_thread("jack");
+	perf_thread();
+}
+
 audio::audio()
 {
+	m_events.resize(HOST_EVENTS);
+}
+
+audio::~audio()
+{
+	stop();
 }
 
 uint32_t audio::samplerate()
@@ -42,6 +77,74 @@ uint32_t audio::buffersize()
 	return jack_get_buffer_size(m_jc);
 }
 
+int audio::priority()
+{
+	return jack_client_real_time_priority(m_jc);
+}
+
+// the engine latency sits between the midi input and the audio outputs
+
+void audio::latency(jack_latency_callback_mode_t mode)
+{
+	jack_nframes_t l = m_engine ? m_engine->latency() : 0;
+	jack_latency_range_t range;
+
+	if (mode == JackCaptureLatency)
+	{
+		jack_port_get_latency_range(m_midi_in_port, mode, &range);
+		range.min += l;
+		range.max += l;
+
+		jack_port_set_latency_range(m_audio_out_port[0], mode, &range);
+		jack_port_set_latency_range(m_audio_out_port[1], mode, &range);
+	}
+	else
+	{
+		jack_latency_range_t right;
+		jack_port_get_latency_range(m_audio_out_port[0], mode, &range);
+		jack_port_get_latency_range(m_audio_out_port[1], mode, &right);
+		range.min = std::min(range.min, right.min) + l;
+		range.max = std::max(range.max, right.max) + l;
+
+		jack_port_set_latency_range(m_midi_in_port, mode, &range);
+	}
+}
+
+// the engine buffers must hold the new period, and the plugins configured
+// for a smaller one are configured again
+
+int audio::buffersize_changed(jack_nframes_t nframes)
+{
+	if (m_engine)
+	{
+		m_engine->reset(nframes, jack_get_sample_rate(m_jc));
+	}
+
+	return 0;
+}
+
+// jack calls it from its own thread, the next callback records the blocks before
+
+int audio::xrun()
+{
+	if (m_xrunlog)
+	{
+		m_xrunlog->xrun(jack_get_xrun_delayed_usecs(m_jc));
+	}
+
+	return 0;
+}
+
+// call after the engine latency changed, not from the audio thread
+
+void audio::update_latency()
+{
+	if (m_jc)
+	{
+		jack_recompute_total_latencies(m_jc);
+	}
+}
+
 
 void audio::connect_ports()
 {
@@ -86,6 +189,10 @@ bool audio::start(const char *id, engine *e)
 
 	//
 	jack_set_process_callback(m_jc, _process, this);	
+	jack_set_latency_callback(m_jc, _latency, this);
+	jack_set_buffer_size_callback(m_jc, _buffersize, this);
+	jack_set_xrun_callback(m_jc, _xrun, this);
+	jack_set_thread_init_callback(m_jc, _thread_init, this);
 
 	//
 	m_midi_in_port = jack_port_register(m_jc, "midi-in",
@@ -154,6 +261,25 @@ void audio::stop()
 
 int audio::process(jack_nframes_t nframes)
 {
+	tracescope trace("audio", "callback");
+
+	// jitter: how late this thread woke up after the period started
+
+	if (m_xrunlog)
+	{
+		jack_nframes_t frames;
+		jack_time_t current, next;
+		float period;
+		int64_t jitter = 0;
+
+		if (jack_get_cycle_times(m_jc, &frames, &current, &next, &period) == 0)
+		{
+			jitter = (int64_t(jack_get_time()) - int64_t(current)) * 1000;
+		}
+
+		m_xrunlog->begin(nframes, jack_get_sample_rate(m_jc), jitter);
+	}
+
 	auto *out1 = (jack_default_audio_sample_t *)jack_port_get_buffer(m_audio_out_port[0], nframes);
 	auto *out2 = (jack_default_audio_sample_t *)jack_port_get_buffer(m_audio_out_port[1], nframes);
 	jack_default_audio_sample_t *outs[] = {out1, out2};
@@ -161,48 +287,40 @@ int audio::process(jack_nframes_t nframes)
 	void* midi_buf = jack_port_get_buffer(m_midi_in_port, nframes);
 
 	jack_nframes_t count = jack_midi_get_event_count(midi_buf);
-	jack_nframes_t index = 0;
-	jack_nframes_t frame = 0;
-	jack_nframes_t delta = 0;
-
+	uint32_t n = 0;
 
 	jack_midi_event_t e;
+	uint64_t midi_start = trace_enabled() ? load_clock() : 0;
 
-	while (nframes)
+	for (jack_nframes_t index = 0; index < count && n < m_events.size(); ++index)
 	{
-		delta = nframes;
+		jack_midi_event_get(&e, midi_buf, index);
 
-		while (index < count)
+		if (e.size == 0 || e.size > sizeof(plum_event::data))
 		{
-			jack_midi_event_get(&e, midi_buf, index);
-
-			if (e.time == frame)
-			{
-				if (m_engine)
-				{
-					m_engine->midi(e.buffer);
-				}
-
-				++index;
-			}
-			else
-			{
-				delta = e.time - frame;
-				frame = e.time;
-
-				break;
-			}
+			continue;
 		}
 
-		if (m_engine)
-		{
+		auto &ev = m_events[n++];
+		ev.frame = std::min(e.time, nframes - 1);
+		ev.size = e.size;
+		std::copy(e.buffer, e.buffer + e.size, ev.data);
+	}
 
-			m_engine->process(delta, nullptr, outs);
-		}
+	if (midi_start)
+	{
+		trace_event("audio", "midi", midi_start, load_clock());
+	}
 
-		nframes -= delta;
-		outs[0] += delta;
-		outs[1] += delta;
+	if (m_engine)
+	{
+		rtscope rt;
+		m_engine->process(nframes, m_events.data(), n, nullptr, outs);
+	}
+
+	if (m_xrunlog)
+	{
+		m_xrunlog->end();
 	}
 
 	return 0;
@@ -23,35 +23,44 @@
 #pragma once
 
 #include <stdio.h>
+#include <vector>
 #include <jack/jack.h>
 #include <jack/midiport.h>
+#include <jack/statistics.h>
 
-class engine
-{
-public:
-	virtual void reset(uint32_t buffersize, uint32_t samplerate) = 0;
-	virtual void midi(uint8_t *e) = 0;
-	virtual void process(uint32_t nframes, float **ins, float **outs) = 0;
-};
+#include "plumext.h"
+#include "backend.h"
 
+// the jack backend
 
-class audio
+class audio : public backend
 {
 	friend int _process(jack_nframes_t nframes, void *arg);
+	friend void _latency(jack_latency_callback_mode_t mode, void *arg);
+	friend int _buffersize(jack_nframes_t nframes, void *arg);
+	friend int _xrun(void *arg);
 	int process(jack_nframes_t nframes);
+	void latency(jack_latency_callback_mode_t mode);
+	int buffersize_changed(jack_nframes_t nframes);
+	int xrun();
 	void connect_ports();
 
 public:
 	audio();
-	bool start(const char *id, engine *e);
-	void stop();
-	uint32_t samplerate();
-	uint32_t buffersize();
+	~audio();
+
+	bool start(const char *id, engine *e) override;
+	void stop() override;
+	uint32_t samplerate() override;
+	uint32_t buffersize() override;
+	int priority() override;
+	void update_latency() override;
 
 private:
-	jack_client_t *m_jc;
-	jack_port_t *m_midi_in_port;
-	jack_port_t *m_audio_out_port[2];
+	jack_client_t *m_jc {nullptr};
+	jack_port_t *m_midi_in_port {nullptr};
+	jack_port_t *m_audio_out_port[2] {nullptr, nullptr};
 
 	engine *m_engine {nullptr};	
+	std::vector<plum_event> m_events;
 };
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <sstream>
+
+#include "backend.h"
+#include "nullbackend.h"
+#include "filebackend.h"
+
+#ifdef PLUM_JACK
+#include "audio.h"
+#endif
+
+std::unique_ptr<backend> create_backend(const std::string &spec)
+{
+	std::stringstream ss(spec);
+	std::string name, item;
+	backendoptions options;
+
+	std::getline(ss, name, ',');
+
+	while (std::getline(ss, item, ','))
+	{
+		auto eq = item.find('=');
+		if (eq == std::string::npos)
+		{
+			printf("BACKEND ERROR: bad option %s\n", item.c_str());
+			continue;
+		}
+
+		options[item.substr(0, eq)] = item.substr(eq + 1);
+	}
+
+	if (name.empty() || name == "jack")
+	{
+#ifdef PLUM_JACK
+		return std::unique_ptr<backend>(new audio);
+#else
+		printf("BACKEND ERROR: built without jack, using null\n");
+		return std::unique_ptr<backend>(new nullbackend(options));
+#endif
+	}
+	else if (name == "null")
+	{
+		return std::unique_ptr<backend>(new nullbackend(options));
+	}
+	else if (name == "file")
+	{
+		return std::unique_ptr<backend>(new filebackend(options));
+	}
+
+#ifdef PLUM_JACK
+	printf("BACKEND ERROR: unknown backend %s, using jack\n", name.c_str());
+	return std::unique_ptr<backend>(new audio);
+#else
+	printf("BACKEND ERROR: unknown backend %s, using null\n", name.c_str());
+	return std::unique_ptr<backend>(new nullbackend(options));
+#endif
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "engine.h"
+#include "xrunlog.h"
+
+// where the engine gets its periods from: jack, a timer or files
+
+class backend
+{
+public:
+	virtual ~backend() {}
+
+	virtual bool start(const char *id, engine *e) = 0;
+	virtual void stop() = 0;
+
+	virtual uint32_t samplerate() = 0;
+	virtual uint32_t buffersize() = 0;
+
+	// realtime priority of the thread calling the engine, 0 if none
+	virtual int priority() = 0;
+
+	// the engine latency changed, not called from the audio thread
+	virtual void update_latency() {}
+
+	// the backend ran out of input and stopped calling the engine
+	virtual bool finished() { return false; }
+
+	// callback timing and xruns go to the log, set before start()
+	void set_xrunlog(xrunlog *log) { m_xrunlog = log; }
+
+protected:
+	xrunlog *m_xrunlog {nullptr};
+};
+
+typedef std::map<std::string, std::string> backendoptions;
+
+// spec: "jack", "null[,rate=48000][,block=256]" or
+// "file,out=render.wav[,in=input.wav|input.mid|input.raw][,rate=..][,block=..][,seconds=..]".
+// jack is only there where PLUM_JACK is defined, plumhost, the others fall
+// back to null.
+std::unique_ptr<backend> create_backend(const std::string &spec);
@@ -21,189 +21,338 @@
  */
 
 #include <algorithm>
+#include <chrono>
+#include <thread>
 
 #include "engine.h"
 
-trackitem::trackitem(plum::iplugin *p, uint32_t buffer_size) : plugin(p)
+
+uint32_t track_engine::max_effects()
 {
-	plugin->reference();
-	allocate_io(buffer_size);
-	plugin->activate();
+	return m_slots.size() - 1;
 }
 
-trackitem::~trackitem()
+
+track_engine::track_engine()
 {
-	plugin->deactivate();
-	plugin->release();
+	m_program = m_graph.compile(0, 0);
 }
 
-void trackitem::allocate_io(uint32_t buffer_size)
+track_engine::~track_engine()
 {
-	buffersize = buffer_size;
+	delete m_program.exchange(nullptr);
+}
 
-	uint32_t ni = plugin->count_inputs();
-	ins.resize(ni);
+// the audio thread makes m_epoch odd while it reads the program,
+// the gui thread waits for an even or a new value before freeing
 
-	uint32_t no = plugin->count_outputs();
-	outs.resize(no);
+graphprogram *track_engine::read_lock()
+{
+	m_epoch.fetch_add(1);
+	return m_program.load();
+}
 
-	buffers.resize(buffer_size * (ni + no));
+void track_engine::read_unlock()
+{
+	m_epoch.fetch_add(1, std::memory_order_release);
+}
 
-	uint32_t i, k = 0;
+void track_engine::synchronize()
+{
+	uint32_t e = m_epoch.load();
 
-	for (i = 0; i < ni; ++i, k += buffer_size)
+	if (e & 1)
 	{
-		ins[i] = &buffers[k];
+		while (m_epoch.load(std::memory_order_acquire) == e)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
 	}
+}
 
-	for (i = 0; i < no; ++i, k += buffer_size)
+bool track_engine::commit()
+{
+	auto p = m_graph.compile(m_buffersize, m_samplerate);
+	if (p == nullptr)
 	{
-		outs[i] = &buffers[k];
+		return false;
 	}
-}	
 
-void trackitem::process(uint32_t nframes)
-{
-	plugin->process(nframes, ins.data(), outs.data());
-}
+	m_latency = p->latency();
 
-void trackitem::copy(uint32_t nframes, uint32_t index, float *buffer)
-{
-	std::copy(outs[index], outs[index] + nframes, buffer);
+	retire(m_program.exchange(p));
+	return true;
 }
 
+// the old program and the removed items are deleted once the audio thread
+// left the block that could still see them. deleting an item deactivates
+// and releases its plugin, which stays off the gui thread.
 
+void track_engine::retire(graphprogram *old)
+{
+	auto garbage = std::move(m_garbage);
+	m_garbage.clear();
 
+	auto reclaim = [old, garbage]
+	{
+		delete old;
 
+		for (auto item : garbage)
+		{
+			delete item;
+		}
+	};
 
+	if (m_house == nullptr)
+	{
+		synchronize();
+		reclaim();
+		return;
+	}
 
+	uint32_t e = m_epoch.load();
 
-uint32_t track_engine::max_effects()
-{
-	return m_effects.size();
+	m_house->retire([this, e] {return !(e & 1) || m_epoch.load(std::memory_order_acquire) != e;}, 
+		reclaim);
 }
 
-
-track_engine::track_engine()
+void track_engine::set_housekeeper(housekeeper *house)
 {
-	m_effects.reserve(8);
+	m_house = house;
 }
 
-void track_engine::set_synth(plum::iplugin *s)
+void track_engine::edit(housekeeper::job j)
 {
-	auto old = m_synth;
-
-	trackitem *ti = nullptr;
-
-	if (s)
+	if (m_house)
+	{
+		m_house->post(std::move(j));
+	}
+	else
 	{
-		ti = new trackitem(s, m_buffersize);
+		j();
 	}
+}
+
+// blocksize: the re-blocking size of the node, 0 for the plugin's own choice.
+// the plugin comes configured for the engine's size and rate, or for its own block.
+
+uint32_t track_engine::add_node(plum::iplugin *plugin, bool midi, uint32_t blocksize)
+{
+	auto item = new trackitem(plugin, blocksize);
+	item->configured = item->blocksize ? item->blocksize : m_buffersize;
+	item->rate = m_samplerate;
+	item->reserve_events(m_period);
 
-	m_sync.lock();
-	m_synth = ti;
-	m_sync.unlock();
+	return m_graph.add_node(item, midi);
+}
 
-	if (old)
+void track_engine::remove_node(uint32_t id)
+{
+	auto item = m_graph.remove_node(id);
+	if (item)
 	{
-		delete old;
+		m_garbage.push_back(item);
 	}
 }
 
+bool track_engine::connect(uint32_t source, uint32_t source_port, uint32_t target, uint32_t target_port)
+{
+	return m_graph.connect(source, source_port, target, target_port);
+}
 
+void track_engine::disconnect(uint32_t source, uint32_t target)
+{
+	m_graph.disconnect(source, target);
+}
 
-void track_engine::set_effect(plum::iplugin *e, uint32_t index)
+void track_engine::chain()
 {
-	auto old = m_effects[index];
+	uint32_t prev = 0;
 
-	trackitem *ti = nullptr;
+	for (auto id : m_slots)
+	{
+		if (id == 0) continue;
+
+		m_graph.disconnect_all(id);
+
+		if (prev)
+		{
+			m_graph.connect(prev, 0, id, 0);
+			m_graph.connect(prev, 1, id, 1);
+		}
+
+		prev = id;
+	}
 
-	if (e)
+	if (prev)
 	{
-		ti = new trackitem(e, m_buffersize);
+		m_graph.connect(prev, 0, graph::output, 0);
+		m_graph.connect(prev, 1, graph::output, 1);
 	}
+}
 
-	m_sync.lock();
-	m_effects[index] = ti;
-	m_sync.unlock();
+void track_engine::set_slot(uint32_t slot, plum::iplugin *plugin, bool midi)
+{
+	if (m_slots[slot])
+	{
+		remove_node(m_slots[slot]);
+		m_slots[slot] = 0;
+	}
 
-	if (old)
+	if (plugin)
 	{
-		delete old;
+		m_slots[slot] = add_node(plugin, midi);
 	}
+
+	chain();
+	commit();
 }
 
-void track_engine::reset(uint32_t buffersize, uint32_t samplerate)
+// the plugin is referenced until the edit ran, the caller may release it
+
+void track_engine::set_synth(plum::iplugin *s)
 {
-	m_buffersize = buffersize;
-	m_samplerate = samplerate;
+	if (s) s->reference();
+
+	edit([this, s] 
+	{
+		set_slot(0, s, true);
+		if (s) s->release();
+	});
 }
 
-void track_engine::midi(uint8_t *e)
+void track_engine::set_effect(plum::iplugin *e, uint32_t index)
 {
-	if (m_synth)
+	if (e) e->reference();
+
+	edit([this, e, index] 
 	{
-		m_synth->plugin->midi_event(e);
-	}
+		set_slot(index + 1, e, false);
+		if (e) e->release();
+	});
 }
 
-void track_engine::process(uint32_t nframes, float **ins, float **outs)
+void track_engine::reset(uint32_t buffersize, uint32_t samplerate)
 {
-	int source = -2;
-	float **target;
-//	uint32_t count;
+	reset(buffersize, samplerate, buffersize);
+}
 
-	m_sync.lock();
+// synchronous: the audio thread must not start with a program of the old size.
+// plugins configured for fewer frames or another rate, or re-blocked with too
+// little room for events, are configured again while the audio thread renders
+// an empty program.
 
-	if (m_synth != nullptr)
-	{
-		m_synth->process(nframes);
-		source = -1;
-	}
-	
-	for (size_t i = 0; i < m_effects.size(); ++i)	
+void track_engine::reset(uint32_t buffersize, uint32_t samplerate, uint32_t period)
+{
+	auto j = [this, buffersize, samplerate, period]
 	{
-		if (m_effects[i] == nullptr) continue;
+		m_buffersize = buffersize;
+		m_samplerate = samplerate;
+		m_period = period;
 
-		target = m_effects[i]->ins.data();
-//		count =  m_effects[i]->ins.size();
+		std::vector<trackitem *> stale;
 
-		if (source == -2)
+		for (auto &n : m_graph.nodes())
 		{
-			std::fill(target[0], target[0] + nframes, 0);
-			std::fill(target[1], target[1] + nframes, 0);
-		}
-		else if (source == -1)
-		{
-			m_synth->copy(nframes, 0, target[0]);
-			m_synth->copy(nframes, 1, target[1]);
+			auto item = n.second.item;
+
+			if (item->configured < (item->blocksize ? item->blocksize : buffersize) 
+				|| item->rate != samplerate || item->block_events.size() < item->events_for(period))
+			{
+				stale.push_back(item);
+			}
 		}
-		else 
+
+		if (!stale.empty())
 		{
-			m_effects[source]->copy(nframes, 0, target[0]);
-			m_effects[source]->copy(nframes, 1, target[1]);
+			graph empty;
+			auto old = m_program.exchange(empty.compile(buffersize, samplerate));
+			synchronize();
+			delete old;
+
+			for (auto item : stale)
+			{
+				item->configure(buffersize, samplerate, period);
+			}
 		}
-		
-		m_effects[i]->process(nframes);
-		source = i;
+
+		commit();
+	};
+
+	if (m_house)
+	{
+		m_house->call(j);
 	}
+	else
+	{
+		j();
+	}
+}
+
+uint32_t track_engine::latency()
+{
+	return m_latency;
+}
+
+// read where the graph is edited, so that no node goes away meanwhile
 
-	if (source == -2)
+void track_engine::collect_loads(std::vector<nodeload> &loads)
+{
+	loads.clear();
+
+	for (auto &n : m_graph.nodes())
 	{
-		std::fill(outs[0], outs[0] + nframes, 0);
-		std::fill(outs[1], outs[1] + nframes, 0);
+		nodeload l;
+		n.second.item->load.read(l);
+		l.id = n.first;
+		l.name = n.second.item->plugin->get_name();
+
+		if (n.second.item->voices)
+		{
+			l.voices = n.second.item->voices->count_voices();
+		}
+
+		auto s = std::find(m_slots.begin(), m_slots.end(), n.first);
+		if (s != m_slots.end())
+		{
+			l.slot = s - m_slots.begin();
+		}
+
+		loads.push_back(l);
 	}
-	else if (source == -1)
+}
+
+// one request at a time is queued, callers meanwhile get the last copy
+
+void track_engine::loads(std::vector<nodeload> &loads)
+{
+	if (m_house == nullptr)
 	{
-		m_synth->copy(nframes, 0, outs[0]);
-		m_synth->copy(nframes, 1, outs[1]);
+		collect_loads(loads);
+		return;
 	}
-	else 
+
+	if (!m_loads_pending.exchange(true))
 	{
-		m_effects[source]->copy(nframes, 0, outs[0]);
-		m_effects[source]->copy(nframes, 1, outs[1]);
+		m_house->post([this]
+		{
+			std::vector<nodeload> fresh;
+			collect_loads(fresh);
+
+			std::lock_guard<std::mutex> lock(m_loads_mutex);
+			m_loads.swap(fresh);
+			m_loads_pending = false;
+		});
 	}
 
+	std::lock_guard<std::mutex> lock(m_loads_mutex);
+	loads = m_loads;
+}
 
-	m_sync.unlock();
+void track_engine::process(uint32_t nframes, const plum_event *events, uint32_t count, 
+	float **ins, float **outs)
+{
+	auto p = read_lock();
+	p->process(nframes, events, count, outs);
+	read_unlock();
 }
@@ -23,34 +23,23 @@
 #pragma once
 
 #include <atomic>
-#include <array>
+#include <mutex>
 #include <vector>
 
 #include "plum.h"
-#include "audio.h"
+#include "plumext.h"
+#include "graph.h"
+#include "housekeeper.h"
 
-class spinlock
-{
-	std::atomic_flag af = ATOMIC_FLAG_INIT;
-
-public:
-	void lock() 	{ while(af.test_and_set()); }
-	void unlock() 	{ af.clear(); }
-};
+// what the audio backend drives, no jack or gtk needed
 
-struct trackitem
+class engine
 {
-	uint32_t buffersize {0};
-	std::vector<float *> ins;
-	std::vector<float *> outs;
-	std::vector<float> buffers;
-	plum::iplugin *plugin {nullptr};
-	
-	trackitem(plum::iplugin *p, uint32_t buffer_size);
-	~trackitem();
-	void allocate_io(uint32_t buffer_size);
-	void process(uint32_t nframes);
-	void copy(uint32_t nframes, uint32_t index, float *buffer);
+public:
+	virtual void reset(uint32_t buffersize, uint32_t samplerate) = 0;
+	virtual void process(uint32_t nframes, const plum_event *events, uint32_t count, 
+		float **ins, float **outs) = 0;
+	virtual uint32_t latency() = 0;
 };
 
 
@@ -59,21 +48,66 @@ class track_engine : public engine
 {
 public:
 	track_engine();
+	~track_engine();
 
 	void reset(uint32_t buffersize, uint32_t samplerate) override;
-	void midi(uint8_t *e) override;
-	void process(uint32_t nframes, float **ins, float **outs) override;
+	void process(uint32_t nframes, const plum_event *events, uint32_t count, 
+		float **ins, float **outs) override;
+	uint32_t latency() override;
+
+	// period: the frames of a backend callback when the engine renders in
+	// larger blocks, it bounds the events of a re-blocking node
+	void reset(uint32_t buffersize, uint32_t samplerate, uint32_t period);
+
+	// dsp time of every node, slot is the preset topology position or -1.
+	// with a housekeeper it asks for a new copy behind the edits and returns
+	// the one taken before, so the gui never waits for them.
+	void loads(std::vector<nodeload> &loads);
 
+	// edits and reclamation run on the housekeeper when there is one
+	void set_housekeeper(housekeeper *);
+	void edit(housekeeper::job j);
+
+	// preset topology: one synth followed by a serial chain of effects.
+	// both are posted as edits.
 	void set_synth(plum::iplugin *);
 	void set_effect(plum::iplugin *, uint32_t index);
 
 	uint32_t max_effects();
 
+	// free routing, changes are published by commit(). 
+	// call them from an edit().
+	uint32_t add_node(plum::iplugin *, bool midi, uint32_t blocksize = 0);
+	void remove_node(uint32_t id);
+	bool connect(uint32_t source, uint32_t source_port, uint32_t target, uint32_t target_port);
+	void disconnect(uint32_t source, uint32_t target);
+	bool commit();
+
+	// read side of the published program, audio thread only
+	graphprogram *read_lock();
+	void read_unlock();
+
 private:
-	uint32_t m_buffersize;
-	uint32_t m_samplerate;
+	void synchronize();
+	void retire(graphprogram *old);
+	void set_slot(uint32_t slot, plum::iplugin *, bool midi);
+	void chain();
+	void collect_loads(std::vector<nodeload> &loads);
+
+	uint32_t m_buffersize {0};
+	uint32_t m_samplerate {0};
+	uint32_t m_period {0};
+
+	graph m_graph;
+	std::vector<uint32_t> m_slots {0, 0, 0, 0, 0};
+	std::vector<trackitem *> m_garbage;
+	housekeeper *m_house {nullptr};
+
+	std::atomic<graphprogram *> m_program;
+	std::atomic<uint32_t> m_epoch {0};
+	std::atomic<uint32_t> m_latency {0};
 
-	trackitem *m_synth {nullptr};
-	std::vector<trackitem *> m_effects {nullptr, nullptr, nullptr, nullptr};
-	spinlock m_sync;
+	std::mutex m_loads_mutex;
+	std::vector<nodeload> m_loads;
+	std::atomic<bool> m_loads_pending {false};
 };
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <chrono>
+
+#include "filebackend.h"
+#include "tracer.h"
+#include "perfcounters.h"
+#include "rtcheck.h"
+
+static bool ends_with(const std::string &s, const std::string &suffix)
+{
+	return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+
+filebackend::filebackend(const backendoptions &options)
+{
+	auto o = options.find("in");
+	if (o != options.end()) m_in = o->second;
+
+	o = options.find("out");
+	m_out = o != options.end() ? o->second : "render.wav";
+
+	o = options.find("rate");
+	if (o != options.end()) m_samplerate = std::stoul(o->second);
+
+	o = options.find("block");
+	if (o != options.end()) m_buffersize = std::stoul(o->second);
+
+	o = options.find("seconds");
+	if (o != options.end()) m_seconds = std::stod(o->second);
+}
+
+filebackend::~filebackend()
+{
+	stop();
+}
+
+uint32_t filebackend::samplerate()
+{
+	return m_samplerate;
+}
+
+uint32_t filebackend::buffersize()
+{
+	return m_buffersize;
+}
+
+int filebackend::priority()
+{
+	return 0;
+}
+
+bool filebackend::finished()
+{
+	return m_finished;
+}
+
+bool filebackend::start(const char *id, engine *e)
+{
+	stop();
+
+	m_audio_in = false;
+	m_song.clear();
+	m_length = uint64_t(m_seconds * m_samplerate);
+
+	// a midi file plays its events plus two seconds of tail
+
+	if (ends_with(m_in, ".mid"))
+	{
+		smf song;
+		if (!song.open(m_in))
+		{
+			return false;
+		}
+
+		m_song = song.events(m_samplerate);
+
+		if (m_length == 0)
+		{
+			m_length = (m_song.empty() ? 0 : m_song.back().frame) + 2 * m_samplerate;
+		}
+	}
+	else if (!m_in.empty())
+	{
+		if (!m_reader.open(m_in, ends_with(m_in, ".raw")))
+		{
+			return false;
+		}
+
+		if (m_reader.samplerate() && m_reader.samplerate() != m_samplerate)
+		{
+			printf("FILE BACKEND: %s is %u Hz, played at %u Hz\n", 
+				m_in.c_str(), m_reader.samplerate(), m_samplerate);
+		}
+
+		m_audio_in = true;
+	}
+
+	if (!m_audio_in && m_length == 0)
+	{
+		printf("FILE BACKEND ERROR: nothing to render, give in= or seconds=\n");
+		return false;
+	}
+
+	if (!m_writer.open(m_out, m_samplerate, 2, ends_with(m_out, ".raw")))
+	{
+		return false;
+	}
+
+	m_engine = e;
+	if (m_engine)
+	{
+		m_engine->reset(m_buffersize, m_samplerate);
+	}
+
+	m_quit = false;
+	m_finished = false;
+	m_thread = std::thread(&filebackend::loop, this);
+	return true;
+}
+
+void filebackend::stop()
+{
+	if (m_thread.joinable())
+	{
+		m_quit = true;
+		m_thread.join();
+	}
+
+	m_reader.close();
+	m_writer.close();
+}
+
+// audio input ends with the file unless seconds is given
+
+void filebackend::loop()
+{
+	trace_thread("file");
+	perf_thread();
+
+	std::vector<float> buffer(m_buffersize * 4);
+	float *ins[2] {buffer.data(), buffer.data() + m_buffersize};
+	float *outs[2] {buffer.data() + 2 * m_buffersize, buffer.data() + 3 * m_buffersize};
+	std::vector<plum_event> events;
+
+	auto t0 = std::chrono::steady_clock::now();
+
+	uint64_t frame = 0;
+	size_t next = 0;
+
+	while (!m_quit)
+	{
+		uint32_t nframes = m_buffersize;
+
+		if (m_length)
+		{
+			if (frame >= m_length) break;
+			nframes = std::min<uint64_t>(nframes, m_length - frame);
+		}
+
+		if (m_audio_in)
+		{
+			uint32_t n = m_reader.read(ins, nframes);
+			if (n == 0 && m_length == 0) break;
+			if (m_length == 0) nframes = n;
+		}
+
+		events.clear();
+
+		for (; next < m_song.size() && m_song[next].frame < frame + nframes; ++next)
+		{
+			auto &e = m_song[next];
+			plum_event x {uint32_t(e.frame - frame), e.size, {}};
+			std::copy(e.data, e.data + 4, x.data);
+			events.push_back(x);
+		}
+
+		if (m_engine)
+		{
+			tracescope trace("audio", "callback");
+			rtscope rt;
+			m_engine->process(nframes, events.data(), events.size(), ins, outs);
+		}
+
+		if (!m_writer.write(outs, nframes))
+		{
+			break;
+		}
+
+		frame += nframes;
+	}
+
+	m_writer.close();
+
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	double seconds = double(frame) / m_samplerate;
+
+	printf("FILE BACKEND: %s: %.2f s in %.3f s, realtime factor %.1fx\n", 
+		m_out.c_str(), seconds, wall, wall > 0 ? seconds / wall : 0);
+
+	m_finished = true;
+}
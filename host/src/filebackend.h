@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "backend.h"
+#include "smf.h"
+#include "wav.h"
+
+// runs the engine as fast as it can between files: the input is a wave or
+// raw file for the audio inputs or a midi file for the events, the output is
+// a wave or raw file. the render length is the input length, or seconds.
+
+class filebackend : public backend
+{
+public:
+	filebackend(const backendoptions &options);
+	~filebackend();
+
+	bool start(const char *id, engine *e) override;
+	void stop() override;
+
+	uint32_t samplerate() override;
+	uint32_t buffersize() override;
+	int priority() override;
+	bool finished() override;
+
+private:
+	void loop();
+
+	std::string m_in;
+	std::string m_out;
+	uint32_t m_samplerate {48000};
+	uint32_t m_buffersize {256};
+	double m_seconds {0};
+
+	engine *m_engine {nullptr};
+	std::thread m_thread;
+	std::atomic<bool> m_quit {false};
+	std::atomic<bool> m_finished {false};
+
+	wavreader m_reader;
+	wavwriter m_writer;
+	bool m_audio_in {false};
+	std::vector<smfevent> m_song;
+	uint64_t m_length {0};
+};
@@ -0,0 +1,1000 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <set>
+
+#include "graph.h"
+#include "tracer.h"
+
+// block 0 uses the size the plugin asks for, if any
+
+trackitem::trackitem(plum::iplugin *p, uint32_t block) : plugin(p), blocksize(block)
+{
+	plugin->reference();
+	name = plugin->get_name();
+
+	auto x = (plum::iinplace *)plugin->as(IFID_PLUM_INPLACE);
+	if (x)
+	{
+		inplace = true;
+		x->release();
+	}
+
+	events = (plum::ievents *)plugin->as(IFID_PLUM_EVENTS);
+	tail = (plum::itail *)plugin->as(IFID_PLUM_TAIL);
+	latency = (plum::ilatency *)plugin->as(IFID_PLUM_LATENCY);
+	voices = (plum::ivoices *)plugin->as(IFID_PLUM_VOICES);
+
+	ins_at.resize(plugin->count_inputs());
+	outs_at.resize(plugin->count_outputs());
+
+	if (blocksize == 0)
+	{
+		auto b = (plum::iblocksize *)plugin->as(IFID_PLUM_BLOCKSIZE);
+		if (b)
+		{
+			blocksize = b->get_block_size();
+			b->release();
+		}
+	}
+
+	if (blocksize)
+	{
+		uint32_t channels = ins_at.size() + outs_at.size();
+		fifo.resize(channels * blocksize, 0);
+
+		for (size_t i = 0; i < ins_at.size(); ++i)
+		{
+			block_ins.push_back(fifo.data() + i * blocksize);
+		}
+
+		for (size_t i = 0; i < outs_at.size(); ++i)
+		{
+			block_outs.push_back(fifo.data() + (ins_at.size() + i) * blocksize);
+		}
+
+		block_events.resize(HOST_EVENTS);
+	}
+
+	plugin->activate();
+}
+
+trackitem::~trackitem()
+{
+	plugin->deactivate();
+
+	if (events)
+	{
+		events->release();
+	}
+
+	if (tail)
+	{
+		tail->release();
+	}
+
+	if (latency)
+	{
+		latency->release();
+	}
+
+	if (voices)
+	{
+		voices->release();
+	}
+
+	plugin->release();
+}
+
+// not while the plugin can be rendered. behind the adapter it keeps its block.
+
+void trackitem::configure(uint32_t buffersize, uint32_t samplerate, uint32_t period)
+{
+	configured = blocksize ? blocksize : buffersize;
+	rate = samplerate;
+	reserve_events(period);
+
+	plugin->deactivate();
+	plugin->configure(rate, configured);
+	plugin->activate();
+}
+
+// the adapter holds the events of every host period a block spans.
+// not while the plugin can be rendered.
+
+uint32_t trackitem::events_for(uint32_t period)
+{
+	if (blocksize == 0 || period == 0)
+	{
+		return 0;
+	}
+
+	return HOST_EVENTS * ((blocksize + period - 1) / period + 1);
+}
+
+void trackitem::reserve_events(uint32_t period)
+{
+	this->period = period;
+
+	if (block_events.size() < events_for(period))
+	{
+		block_events.resize(events_for(period));
+	}
+}
+
+// quiet: no sound on the inputs and no events in this block.
+// idle counts the quiet frames before the block.
+
+bool trackitem::sleeping(uint32_t nframes, bool quiet)
+{
+	if (!quiet)
+	{
+		idle = 0;
+		return false;
+	}
+
+	uint32_t t = tail ? tail->get_tail() : PLUM_TAIL_INFINITE;
+	if (t != PLUM_TAIL_INFINITE)
+	{
+		t = std::min(uint64_t(t) + blocksize, uint64_t(PLUM_TAIL_INFINITE - 1));
+	}
+
+	bool asleep = t != PLUM_TAIL_INFINITE && idle >= t;
+
+	idle = idle < UINT32_MAX - nframes ? idle + nframes : UINT32_MAX;
+	return asleep;
+}
+
+uint32_t trackitem::get_latency()
+{
+	return (latency ? latency->get_latency() : 0) + blocksize;
+}
+
+void trackitem::process(uint32_t nframes, float **ins, float **outs, 
+	const plum_event *e, uint32_t count)
+{
+	uint64_t c0[PERF_COUNTERS];
+	bool counted = perf_enabled() && perf_read(c0);
+	uint64_t t0 = load_clock();
+
+	if (blocksize)
+	{
+		reblock(nframes, ins, outs, e, count);
+	}
+	else
+	{
+		run(nframes, ins, outs, e, count);
+	}
+
+	uint64_t t1 = load_clock();
+	load.record(nframes, t0, t1);
+
+	uint64_t c1[PERF_COUNTERS];
+
+	if (counted && perf_read(c1))
+	{
+		load.count(nframes, c0, c1);
+	}
+
+	if (trace_enabled())
+	{
+		trace_event("node", name.c_str(), t0, t1);
+	}
+}
+
+// the input fifo fills while the output of the previous block drains from
+// the same position, a full block is processed in one call
+
+void trackitem::reblock(uint32_t nframes, float **ins, float **outs, 
+	const plum_event *e, uint32_t count)
+{
+	uint32_t done = 0;
+	uint32_t k = 0;
+
+	while (done < nframes)
+	{
+		uint32_t n = std::min(nframes - done, blocksize - fill);
+
+		for (; k < count && e[k].frame < done + n; ++k)
+		{
+			plum_event x = e[k];
+			x.frame = fill + e[k].frame - done;
+			keep_event(x);
+		}
+
+		// inputs first, ins and outs may be the same buffers
+
+		for (size_t i = 0; i < block_ins.size(); ++i)
+		{
+			std::copy(ins[i] + done, ins[i] + done + n, block_ins[i] + fill);
+		}
+
+		for (size_t i = 0; i < block_outs.size(); ++i)
+		{
+			std::copy(block_outs[i] + fill, block_outs[i] + fill + n, outs[i] + done);
+		}
+
+		fill += n;
+		done += n;
+
+		if (fill == blocksize)
+		{
+			run(blocksize, block_ins.data(), block_outs.data(), block_events.data(), block_count);
+			fill = 0;
+			block_count = 0;
+		}
+	}
+}
+
+// past the capacity an event is dropped and counted. a note-off takes the
+// place of the latest other event instead, so that no note hangs.
+
+static bool note_off(const plum_event &e)
+{
+	uint8_t status = e.data[0] & 0xf0;
+	return status == 0x80 || (status == 0x90 && e.data[2] == 0);
+}
+
+void trackitem::keep_event(const plum_event &e)
+{
+	if (block_count < block_events.size())
+	{
+		block_events[block_count++] = e;
+		return;
+	}
+
+	load.dropped_events.fetch_add(1, std::memory_order_relaxed);
+
+	if (!note_off(e))
+	{
+		return;
+	}
+
+	auto end = block_events.begin() + block_count;
+	auto other = std::find_if(std::make_reverse_iterator(end), block_events.rend(),
+		[](const plum_event &x) {return !note_off(x);});
+
+	if (other != block_events.rend())
+	{
+		std::move(other.base(), end, other.base() - 1);
+		block_events[block_count - 1] = e;
+	}
+}
+
+void trackitem::run(uint32_t nframes, float **ins, float **outs, 
+	const plum_event *e, uint32_t count)
+{
+	if (events)
+	{
+		events->process_events(nframes, ins, outs, e, count);
+		return;
+	}
+
+	// fallback: split the block at every event
+
+	uint32_t frame = 0;
+	uint32_t k = 0;
+
+	while (frame < nframes)
+	{
+		while (k < count && e[k].frame <= frame)
+		{
+			plugin->midi_event((uint8_t *)e[k].data);
+			++k;
+		}
+
+		uint32_t end = k < count ? std::min(e[k].frame, nframes) : nframes;
+
+		for (size_t i = 0; i < ins_at.size(); ++i) ins_at[i] = ins[i] + frame;
+		for (size_t i = 0; i < outs_at.size(); ++i) outs_at[i] = outs[i] + frame;
+
+		plugin->process(end - frame, ins_at.data(), outs_at.data());
+		frame = end;
+	}
+}
+
+
+
+// ------------------------------------------------------------------------------------
+// PROGRAM
+// ------------------------------------------------------------------------------------
+
+// silent sources are skipped. returns true, leaving the target
+// untouched, when all of them are.
+
+bool graphprogram::mix(uint32_t nframes, const graphmix &m, float *target)
+{
+	bool first = true;
+
+	for (auto s : m.sources)
+	{
+		if (m_silent[s]) continue;
+
+		float *source = m_buffers[s];
+
+		if (first)
+		{
+			std::copy(source, source + nframes, target);
+			first = false;
+			continue;
+		}
+
+		for (uint32_t i = 0; i < nframes; ++i)
+		{
+			target[i] += source[i];
+		}
+	}
+
+	return first;
+}
+
+// a pool buffer already flagged silent still holds zeros, the direct
+// outputs belong to someone else and are always cleared
+
+void graphprogram::clear(uint32_t nframes, uint32_t flag, float *buffer)
+{
+	if (!m_silent[flag] || flag >= m_buffers.size())
+	{
+		std::fill(buffer, buffer + nframes, 0);
+	}
+
+	m_silent[flag] = 1;
+}
+
+bool graphprogram::silent()
+{
+	return m_output_silent;
+}
+
+uint32_t graphprogram::latency()
+{
+	return m_latency;
+}
+
+uint32_t graphprogram::count_steps()
+{
+	return m_steps.size();
+}
+
+trackitem *graphprogram::step_item(uint32_t index)
+{
+	return m_steps[index].item;
+}
+
+// once the ring holds nothing but silence the delay is skipped
+
+void graphprogram::delay(uint32_t nframes, graphdelay &d)
+{
+	float *in = m_buffers[d.source];
+	float *out = m_buffers[d.target];
+	auto &line = *d.line;
+	uint32_t length = line.ring.size();
+
+	line.quiet = m_silent[d.source] ? std::min(line.quiet + nframes, length + nframes) : 0;
+
+	if (line.quiet >= length + nframes)
+	{
+		clear(nframes, d.target, out);
+		return;
+	}
+
+	m_silent[d.target] = 0;
+
+	for (uint32_t i = 0; i < nframes; ++i)
+	{
+		out[i] = line.ring[line.pos];
+		line.ring[line.pos] = in[i];
+
+		if (++line.pos == length)
+		{
+			line.pos = 0;
+		}
+	}
+}
+
+void graphprogram::run_step(uint32_t nframes, graphstep &step)
+{
+	for (auto &d : step.delays)
+	{
+		delay(nframes, d);
+	}
+
+	for (auto &m : step.mixes)
+	{
+		if (mix(nframes, m, m_buffers[m.target]))
+		{
+			clear(nframes, m.target, m_buffers[m.target]);
+		}
+		else
+		{
+			m_silent[m.target] = 0;
+		}
+	}
+
+	bool quiet = !step.midi || m_count == 0;
+
+	for (auto f : step.in_flags)
+	{
+		quiet = quiet && m_silent[f];
+	}
+
+	if (step.item->sleeping(nframes, quiet))
+	{
+		for (size_t o = 0; o < step.outs.size(); ++o)
+		{
+			clear(nframes, step.out_flags[o], step.outs[o]);
+		}
+
+		return;
+	}
+
+	for (auto f : step.out_flags)
+	{
+		m_silent[f] = 0;
+	}
+
+	if (step.midi)
+	{
+		step.item->process(nframes, step.ins.data(), step.outs.data(), m_events, m_count);
+	}
+	else
+	{
+		step.item->process(nframes, step.ins.data(), step.outs.data(), nullptr, 0);
+	}
+}
+
+void graphprogram::bind(float **outs)
+{
+	for (auto &d : m_direct)
+	{
+		m_steps[d.step].outs[d.port] = outs[d.channel];
+	}
+}
+
+void graphprogram::output(uint32_t nframes, float **outs)
+{
+	bool silent = true;
+
+	for (auto &d : m_output_delays)
+	{
+		delay(nframes, d);
+	}
+
+	for (auto &m : m_outputs)
+	{
+		if (mix(nframes, m, outs[m.target]))
+		{
+			std::fill(outs[m.target], outs[m.target] + nframes, 0);
+		}
+		else
+		{
+			silent = false;
+		}
+	}
+
+	for (auto &d : m_direct)
+	{
+		silent = silent && m_silent[m_steps[d.step].out_flags[d.port]];
+	}
+
+	m_output_silent = silent;
+}
+
+void graphprogram::process(uint32_t nframes, const plum_event *events, uint32_t count, float **outs)
+{
+	m_events = events;
+	m_count = count;
+	bind(outs);
+
+	for (auto &step : m_steps)
+	{
+		run_step(nframes, step);
+	}
+
+	output(nframes, outs);
+}
+
+
+
+// ------------------------------------------------------------------------------------
+// GRAPH
+// ------------------------------------------------------------------------------------
+
+uint32_t graph::add_node(trackitem *item, bool midi)
+{
+	graphnode node;
+	node.item = item;
+	node.inputs = item->plugin->count_inputs();
+	node.outputs = item->plugin->count_outputs();
+	node.midi = midi;
+	node.inplace = item->inplace;
+
+	uint32_t id = m_next_id++;
+	m_nodes[id] = node;
+	return id;
+}
+
+trackitem *graph::remove_node(uint32_t id)
+{
+	auto p = m_nodes.find(id);
+	if (p == m_nodes.end())
+	{
+		return nullptr;
+	}
+
+	disconnect_all(id);
+
+	auto item = p->second.item;
+	m_nodes.erase(p);
+	return item;
+}
+
+// depth first with every node visited once, diamonds don't multiply the paths
+
+bool graph::reaches(uint32_t from, uint32_t to)
+{
+	std::set<uint32_t> visited {from};
+	std::vector<uint32_t> pending {from};
+
+	while (!pending.empty())
+	{
+		uint32_t id = pending.back();
+		pending.pop_back();
+
+		if (id == to)
+		{
+			return true;
+		}
+
+		for (auto &e : m_edges)
+		{
+			if (e.source == id && visited.insert(e.target).second)
+			{
+				pending.push_back(e.target);
+			}
+		}
+	}
+
+	return false;
+}
+
+// an edge whose delay keeps its length keeps its line, the new program
+// takes over the signal where the old one left it
+
+std::shared_ptr<delayline> graph::delay_line(const graphedge &e, uint32_t length, delaylines &used)
+{
+	auto key = std::make_tuple(e.source, e.source_port, e.target, e.target_port);
+	auto d = m_delays.find(key);
+
+	if (d != m_delays.end() && d->second->ring.size() == length)
+	{
+		return used[key] = d->second;
+	}
+
+	auto line = std::make_shared<delayline>();
+	line->ring.resize(length, 0);
+	return used[key] = line;
+}
+
+bool graph::connect(uint32_t source, uint32_t source_port, uint32_t target, uint32_t target_port)
+{
+	auto s = m_nodes.find(source);
+	if (s == m_nodes.end() || source_port >= s->second.outputs)
+	{
+		return false;
+	}
+
+	if (target == output)
+	{
+		if (target_port >= output_channels) return false;
+	}
+	else
+	{
+		auto t = m_nodes.find(target);
+		if (t == m_nodes.end() || target_port >= t->second.inputs)
+		{
+			return false;
+		}
+
+		if (reaches(target, source))
+		{
+			return false;
+		}
+	}
+
+	for (auto &e : m_edges)
+	{
+		if (e.source == source && e.source_port == source_port 
+			&& e.target == target && e.target_port == target_port)
+		{
+			return true;
+		}
+	}
+
+	m_edges.push_back({source, source_port, target, target_port});
+	return true;
+}
+
+void graph::disconnect(uint32_t source, uint32_t target)
+{
+	m_edges.erase(std::remove_if(m_edges.begin(), m_edges.end(), 
+		[source, target](graphedge &e) 
+		{
+			return e.source == source && e.target == target;
+		}),
+		m_edges.end());
+}
+
+void graph::disconnect_all(uint32_t id)
+{
+	m_edges.erase(std::remove_if(m_edges.begin(), m_edges.end(), 
+		[id](graphedge &e) 
+		{
+			return e.source == id || e.target == id;
+		}),
+		m_edges.end());
+}
+
+const std::map<uint32_t, graphnode> &graph::nodes()
+{
+	return m_nodes;
+}
+
+graphprogram *graph::compile(uint32_t buffersize, uint32_t samplerate)
+{
+	for (auto &n : m_nodes)
+	{
+		n.second.item->load.samplerate = samplerate;
+	}
+
+	// topological sort (Kahn)
+
+	std::map<uint32_t, uint32_t> pending;
+	for (auto &n : m_nodes)
+	{
+		pending[n.first] = 0;
+	}
+
+	for (auto &e : m_edges)
+	{
+		if (e.target != output) ++pending[e.target];
+	}
+
+	std::vector<uint32_t> order;
+	for (auto &p : pending)
+	{
+		if (p.second == 0) order.push_back(p.first);
+	}
+
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		for (auto &e : m_edges)
+		{
+			if (e.source == order[i] && e.target != output)
+			{
+				if (--pending[e.target] == 0) order.push_back(e.target);
+			}
+		}
+	}
+
+	if (order.size() != m_nodes.size())
+	{
+		return nullptr;
+	}
+
+	auto p = new graphprogram;
+	uint32_t n = order.size();
+
+	p->m_steps.resize(n);
+
+	// dependencies, used by the parallel scheduler and by the buffer planner
+
+	std::map<uint32_t, uint32_t> step_of;
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		step_of[order[i]] = i;
+		p->m_steps[i].program = p;
+		p->m_steps[i].item = m_nodes[order[i]].item;
+	}
+
+	std::vector<std::vector<bool>> ancestor(n, std::vector<bool>(n, false));
+
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		auto &step = p->m_steps[i];
+
+		for (auto &e : m_edges)
+		{
+			if (e.source != order[i] || e.target == output) continue;
+
+			uint32_t k = step_of[e.target];
+			if (std::find(step.successors.begin(), step.successors.end(), k) == step.successors.end())
+			{
+				step.successors.push_back(k);
+				++p->m_steps[k].predecessors;
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		for (auto k : p->m_steps[i].successors)
+		{
+			ancestor[k][i] = true;
+
+			for (uint32_t a = 0; a < n; ++a)
+			{
+				if (ancestor[i][a]) ancestor[k][a] = true;
+			}
+		}
+
+		if (p->m_steps[i].predecessors == 0) p->m_roots.push_back(i);
+	}
+
+	p->m_pending.reset(new std::atomic<uint32_t>[n]);
+
+	// latency: a step starts when its slowest input arrives, the other
+	// inputs are delayed to match. the track output waits for the slowest path.
+
+	std::vector<uint32_t> arrive(n, 0);
+	std::vector<uint32_t> done(n, 0);
+	uint32_t total = 0;
+
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		for (auto &e : m_edges)
+		{
+			if (e.target == order[i])
+			{
+				arrive[i] = std::max(arrive[i], done[step_of[e.source]]);
+			}
+		}
+
+		done[i] = arrive[i] + p->m_steps[i].item->get_latency();
+	}
+
+	for (auto &e : m_edges)
+	{
+		if (e.target == output)
+		{
+			total = std::max(total, done[step_of[e.source]]);
+		}
+	}
+
+	p->m_latency = total;
+
+	// buffer planning. a buffer may be overwritten by a step once every step
+	// that still needs its content (guard) is an ancestor of that step, so the
+	// plan is also safe when the scheduler runs independent steps in parallel.
+	// buffer 0 is the silence, buffers read by the track outputs are pinned.
+
+	struct bufferstate
+	{
+		std::vector<uint32_t> guard;
+		bool pinned {false};
+	};
+
+	std::vector<bufferstate> pool(1);
+	pool[0].pinned = true;
+
+	auto reusable = [&](uint32_t b, uint32_t i, bool inplace)
+	{
+		if (pool[b].pinned) return false;
+
+		for (auto g : pool[b].guard)
+		{
+			if (!ancestor[i][g] && !(inplace && g == i)) return false;
+		}
+
+		return true;
+	};
+
+	auto allocate = [&](uint32_t i)
+	{
+		for (uint32_t b = 1; b < pool.size(); ++b)
+		{
+			if (reusable(b, i, false)) return b;
+		}
+
+		pool.push_back(bufferstate());
+		return uint32_t(pool.size() - 1);
+	};
+
+	std::vector<uint32_t> channel_sources(output_channels, 0);
+	for (auto &e : m_edges)
+	{
+		if (e.target == output) ++channel_sources[e.target_port];
+	}
+
+	std::map<std::pair<uint32_t, uint32_t>, uint32_t> port_buffer;
+	delaylines lines;
+	std::vector<std::vector<uint32_t>> ins(n);
+	std::vector<std::vector<uint32_t>> outs(n);
+	std::vector<bool> direct(output_channels, false);
+
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		uint32_t id = order[i];
+		auto &node = m_nodes[id];
+		auto &step = p->m_steps[i];
+
+		step.midi = node.midi;
+
+		for (uint32_t port = 0; port < node.inputs; ++port)
+		{
+			std::vector<uint32_t> s;
+			for (auto &e : m_edges)
+			{
+				if (e.target == id && e.target_port == port)
+				{
+					uint32_t b = port_buffer[{e.source, e.source_port}];
+					uint32_t d = arrive[i] - done[step_of[e.source]];
+
+					if (d > 0)
+					{
+						uint32_t x = allocate(i);
+						pool[x].guard = {i};
+						step.delays.push_back({b, x, delay_line(e, d, lines)});
+						b = x;
+					}
+
+					s.push_back(b);
+				}
+			}
+
+			if (s.size() == 0)
+			{
+				ins[i].push_back(0);
+			}
+			else if (s.size() == 1)
+			{
+				ins[i].push_back(s[0]);
+			}
+			else
+			{
+				uint32_t b = allocate(i);
+				pool[b].guard = {i};
+				step.mixes.push_back({b, s});
+				ins[i].push_back(b);
+			}
+		}
+
+		for (uint32_t o = 0; o < node.outputs; ++o)
+		{
+			std::vector<uint32_t> readers {i};
+			std::vector<uint32_t> channels;
+
+			for (auto &e : m_edges)
+			{
+				if (e.source != id || e.source_port != o) continue;
+
+				if (e.target == output)
+				{
+					channels.push_back(e.target_port);
+				}
+				else
+				{
+					readers.push_back(step_of[e.target]);
+				}
+			}
+
+			// the only reader is a track output: write straight into it
+
+			if (readers.size() == 1 && channels.size() == 1 && channel_sources[channels[0]] == 1
+				&& done[i] == total)
+			{
+				direct[channels[0]] = true;
+				p->m_direct.push_back({i, o, channels[0]});
+				outs[i].push_back(0);
+				continue;
+			}
+
+			uint32_t b = 0;
+
+			if (node.inplace && o < ins[i].size())
+			{
+				uint32_t x = ins[i][o];
+
+				if (x != 0 
+					&& std::count(ins[i].begin(), ins[i].end(), x) == 1
+					&& std::count(outs[i].begin(), outs[i].end(), x) == 0
+					&& reusable(x, i, true))
+				{
+					b = x;
+				}
+			}
+
+			if (b == 0)
+			{
+				b = allocate(i);
+			}
+
+			pool[b].guard = readers;
+			pool[b].pinned = !channels.empty();
+			port_buffer[{id, o}] = b;
+			outs[i].push_back(b);
+		}
+	}
+
+	for (uint32_t c = 0; c < output_channels; ++c)
+	{
+		graphmix m {c, {}};
+
+		if (!direct[c])
+		{
+			for (auto &e : m_edges)
+			{
+				if (e.target == output && e.target_port == c)
+				{
+					uint32_t b = port_buffer[{e.source, e.source_port}];
+					uint32_t d = total - done[step_of[e.source]];
+
+					if (d > 0)
+					{
+						pool.push_back(bufferstate());
+						pool.back().pinned = true;
+
+						uint32_t x = pool.size() - 1;
+						p->m_output_delays.push_back({b, x, delay_line(e, d, lines)});
+						b = x;
+					}
+
+					m.sources.push_back(b);
+				}
+			}
+
+			p->m_outputs.push_back(m);
+		}
+	}
+
+	uint32_t count = pool.size();
+
+	p->m_memory.resize(count * buffersize, 0);
+	p->m_buffers.resize(count);
+	for (uint32_t b = 0; b < count; ++b)
+	{
+		p->m_buffers[b] = p->m_memory.data() + b * buffersize;
+	}
+
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		for (auto b : ins[i]) p->m_steps[i].ins.push_back(p->m_buffers[b]);
+		for (auto b : outs[i]) p->m_steps[i].outs.push_back(p->m_buffers[b]);
+
+		p->m_steps[i].in_flags = ins[i];
+		p->m_steps[i].out_flags = outs[i];
+	}
+
+	// the memory starts zeroed, so every flag starts set
+
+	p->m_silent.resize(count + p->m_direct.size(), 1);
+
+	for (size_t k = 0; k < p->m_direct.size(); ++k)
+	{
+		auto &d = p->m_direct[k];
+		p->m_steps[d.step].out_flags[d.port] = count + k;
+	}
+
+	m_delays.swap(lines);
+	return p;
+}
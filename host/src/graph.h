@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "plum.h"
+#include "plumext.h"
+#include "loadstats.h"
+
+// events per call the adapter makes room for, the jack backend passes no more
+#define HOST_EVENTS 1024
+
+struct trackitem
+{
+	plum::iplugin *plugin {nullptr};
+	plum::ievents *events {nullptr};
+	plum::itail *tail {nullptr};
+	plum::ilatency *latency {nullptr};
+	plum::ivoices *voices {nullptr};
+	bool inplace {false};
+	uint32_t idle {0};
+
+	std::vector<float *> ins_at;
+	std::vector<float *> outs_at;
+
+	// re-blocking adapter: the plugin always gets blocksize frames, the
+	// inputs and events go through a fifo and come out a block later
+	uint32_t blocksize {0};
+	uint32_t fill {0};
+	std::vector<float> fifo;
+	std::vector<float *> block_ins;
+	std::vector<float *> block_outs;
+	std::vector<plum_event> block_events;
+	uint32_t block_count {0};
+
+	// what the plugin was configured with, the engine configures it again
+	// when the period grows past it or the rate changes
+	uint32_t configured {0};
+	uint32_t rate {0};
+	uint32_t period {0};
+
+	std::string name;
+	loadstats load;
+	
+	trackitem(plum::iplugin *p, uint32_t block = 0);
+	~trackitem();
+	void configure(uint32_t buffersize, uint32_t samplerate, uint32_t period);
+	void reserve_events(uint32_t period);
+	uint32_t events_for(uint32_t period);
+	void process(uint32_t nframes, float **ins, float **outs, 
+		const plum_event *events, uint32_t count);
+	bool sleeping(uint32_t nframes, bool quiet);
+	uint32_t get_latency();
+
+private:
+	void run(uint32_t nframes, float **ins, float **outs, 
+		const plum_event *events, uint32_t count);
+	void reblock(uint32_t nframes, float **ins, float **outs, 
+		const plum_event *events, uint32_t count);
+	void keep_event(const plum_event &e);
+};
+
+
+struct graphedge
+{
+	uint32_t source;
+	uint32_t source_port;
+	uint32_t target;
+	uint32_t target_port;
+};
+
+struct graphnode
+{
+	trackitem *item {nullptr};
+	uint32_t inputs {0};
+	uint32_t outputs {0};
+	bool midi {false};
+	bool inplace {false};
+};
+
+class graphprogram;
+
+// sum of several buffers into one (a summing junction)
+struct graphmix
+{
+	uint32_t target;
+	std::vector<uint32_t> sources;
+};
+
+// a step output written straight into a track output
+struct graphdirect
+{
+	uint32_t step;
+	uint32_t port;
+	uint32_t channel;
+};
+
+// what a compensation delay holds. the programs compiled while its edge
+// and length stay the same share it, so other edits don't reset the signal.
+struct delayline
+{
+	std::vector<float> ring;
+	uint32_t pos {0};
+	uint32_t quiet {0};
+};
+
+// compensation delay of an edge, from a source buffer into its own buffer
+struct graphdelay
+{
+	uint32_t source;
+	uint32_t target;
+	std::shared_ptr<delayline> line;
+};
+
+struct graphstep
+{
+	trackitem *item {nullptr};
+	std::vector<graphdelay> delays;
+	std::vector<graphmix> mixes;
+	std::vector<float *> ins;
+	std::vector<float *> outs;
+
+	// silence flags of the inputs and outputs
+	std::vector<uint32_t> in_flags;
+	std::vector<uint32_t> out_flags;
+
+	bool midi {false};
+
+	graphprogram *program {nullptr};
+	std::vector<uint32_t> successors;
+	uint32_t predecessors {0};
+};
+
+
+// flat, topologically sorted execution list built by graph::compile.
+// buffer 0 is always silent.
+class graphprogram
+{
+	friend class graph;
+	friend class scheduler;
+
+public:
+	void process(uint32_t nframes, const plum_event *events, uint32_t count, float **outs);
+
+	void bind(float **outs);
+	void run_step(uint32_t nframes, graphstep &step);
+	void output(uint32_t nframes, float **outs);
+	bool silent();
+	uint32_t latency();
+
+	uint32_t count_steps();
+	trackitem *step_item(uint32_t index);
+
+private:
+	void delay(uint32_t nframes, graphdelay &d);
+	bool mix(uint32_t nframes, const graphmix &m, float *target);
+	void clear(uint32_t nframes, uint32_t flag, float *buffer);
+
+	std::vector<graphstep> m_steps;
+	std::vector<graphmix> m_outputs;
+	std::vector<graphdirect> m_direct;
+	std::vector<graphdelay> m_output_delays;
+	uint32_t m_latency {0};
+	std::vector<float> m_memory;
+	std::vector<float *> m_buffers;
+
+	// one flag per buffer, then one per direct output. a set flag means the
+	// buffer holds zeros. bytes, not bits: steps running in parallel write them.
+	std::vector<uint8_t> m_silent;
+	bool m_output_silent {true};
+
+	// state of the block in flight, used by the scheduler
+	std::vector<uint32_t> m_roots;
+	std::unique_ptr<std::atomic<uint32_t>[]> m_pending;
+	std::atomic<uint32_t> m_remaining {0};
+	float **m_target {nullptr};
+	const plum_event *m_events {nullptr};
+	uint32_t m_count {0};
+	std::atomic<uint64_t> *m_busy {nullptr};
+};
+
+
+class graph
+{
+public:
+	static const uint32_t output = 0;
+	static const uint32_t output_channels = 2;
+
+	uint32_t add_node(trackitem *item, bool midi);
+	trackitem *remove_node(uint32_t id);
+
+	bool connect(uint32_t source, uint32_t source_port, uint32_t target, uint32_t target_port);
+	void disconnect(uint32_t source, uint32_t target);
+	void disconnect_all(uint32_t id);
+
+	graphprogram *compile(uint32_t buffersize, uint32_t samplerate);
+
+	// the nodes by id, for the thread that edits the graph
+	const std::map<uint32_t, graphnode> &nodes();
+
+private:
+	typedef std::map<std::tuple<uint32_t, uint32_t, uint32_t, uint32_t>, std::shared_ptr<delayline>> delaylines;
+
+	bool reaches(uint32_t from, uint32_t to);
+	std::shared_ptr<delayline> delay_line(const graphedge &e, uint32_t length, delaylines &used);
+
+	uint32_t m_next_id {1};
+	std::map<uint32_t, graphnode> m_nodes;
+	std::vector<graphedge> m_edges;
+
+	// the delay lines of the last compiled program, by edge
+	delaylines m_delays;
+};
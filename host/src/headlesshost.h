@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "plum.h"
+#include "jobboard.h"
+
+// a host without a user, for the command line tools: callbacks are ignored
+
+class headlesshost : public plum::ihost
+{
+public:
+	void reference() override {}
+	void release() override {}
+
+	void *as(const char *ifid) override
+	{
+		if (std::string(ifid) == IFID_PLUM_OBJECT || std::string(ifid) == IFID_PLUM_HOST)
+		{
+			reference(); return static_cast<plum::ihost *>(this);
+		}
+
+		if (std::string(ifid) == IFID_PLUM_JOBS && m_jobs)
+		{
+			m_jobs->reference(); return static_cast<plum::ijobs *>(m_jobs);
+		}
+
+		return nullptr;
+	}
+
+	// the job board of the tool's scheduler, for the plugins created after
+	void set_jobs(jobboard *jobs) { m_jobs = jobs; }
+
+	void plugin_preset_selected(plum::iplugin *) override {}
+	void plugin_bank_changed(plum::iplugin *) override {}
+	void plugin_preset_changed(plum::iplugin *, uint32_t) override {}
+
+	void plugin_load_preset(plum::iplugin *) override {}
+	void plugin_save_preset(plum::iplugin *) override {}
+	void plugin_load_bank(plum::iplugin *) override {}
+	void plugin_save_bank(plum::iplugin *) override {}
+
+private:
+	jobboard *m_jobs {nullptr};
+};
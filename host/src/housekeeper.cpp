@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <sys/resource.h>
+
+#include "housekeeper.h"
+#include "tracer.h"
+
+// how often the retired objects are checked
+static const auto poll = std::chrono::milliseconds(2);
+
+
+housekeeper::~housekeeper()
+{
+	stop();
+}
+
+void housekeeper::start()
+{
+	if (m_thread.joinable())
+	{
+		return;
+	}
+
+	m_quit = false;
+	m_thread = std::thread(&housekeeper::loop, this);
+}
+
+// runs what is still queued, then joins
+
+void housekeeper::stop()
+{
+	if (!m_thread.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+
+	m_wake.notify_one();
+	m_thread.join();
+}
+
+void housekeeper::post(job j)
+{
+	if (!m_thread.joinable())
+	{
+		j();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(std::move(j));
+	}
+
+	m_wake.notify_one();
+}
+
+// post and wait for the job to run
+
+void housekeeper::call(job j)
+{
+	if (!m_thread.joinable())
+	{
+		j();
+		return;
+	}
+
+	bool done = false;
+
+	post([&] 
+	{
+		j();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		done = true;
+	});
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [&] {return done;});
+}
+
+void housekeeper::retire(check ready, job reclaim)
+{
+	if (!m_thread.joinable())
+	{
+		while (!ready())
+		{
+			std::this_thread::sleep_for(poll);
+		}
+
+		reclaim();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_retired.push_back({std::move(ready), std::move(reclaim)});
+	}
+
+	m_wake.notify_one();
+}
+
+// waits until every posted job ran and every retired object is gone,
+// e.g. before unloading the library that holds their code
+
+void housekeeper::flush()
+{
+	if (!m_thread.joinable())
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this] {return idle();});
+}
+
+bool housekeeper::idle()
+{
+	return m_jobs.empty() && m_retired.empty() && !m_running;
+}
+
+void housekeeper::loop()
+{
+	// the nice value is per thread on linux
+	setpriority(PRIO_PROCESS, 0, 10);
+	trace_thread("housekeeper");
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (true)
+	{
+		if (!m_jobs.empty())
+		{
+			auto j = std::move(m_jobs.front());
+			m_jobs.pop_front();
+			m_running = true;
+
+			lock.unlock();
+			{
+				tracescope trace("house", "edit");
+				j();
+			}
+			lock.lock();
+
+			m_running = false;
+			m_done.notify_all();
+			continue;
+		}
+
+		if (!m_retired.empty())
+		{
+			std::vector<retired> pending;
+			pending.swap(m_retired);
+			m_running = true;
+
+			lock.unlock();
+
+			std::vector<retired> waiting;
+
+			for (auto &r : pending)
+			{
+				if (r.ready())
+				{
+					r.reclaim();
+				}
+				else
+				{
+					waiting.push_back(std::move(r));
+				}
+			}
+
+			lock.lock();
+
+			m_retired.insert(m_retired.end(), 
+				std::make_move_iterator(waiting.begin()), std::make_move_iterator(waiting.end()));
+			m_running = false;
+		}
+
+		if (idle())
+		{
+			m_done.notify_all();
+
+			if (m_quit)
+			{
+				break;
+			}
+
+			m_wake.wait(lock);
+		}
+		else if (m_jobs.empty())
+		{
+			m_wake.wait_for(lock, poll);
+		}
+	}
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a low priority thread for the work that must stay off the audio and gui
+// threads: graph edits posted by the gui, in order, and retired objects,
+// reclaimed once their check says the audio thread can no longer see them.
+// when the thread is not running everything happens on the calling thread.
+
+class housekeeper
+{
+public:
+	typedef std::function<void()> job;
+	typedef std::function<bool()> check;
+
+	~housekeeper();
+
+	void start();
+	void stop();
+
+	void post(job j);
+	void call(job j);
+	void retire(check ready, job reclaim);
+	void flush();
+
+private:
+	struct retired
+	{
+		check ready;
+		job reclaim;
+	};
+
+	void loop();
+	bool idle();
+
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+
+	std::deque<job> m_jobs;
+	std::vector<retired> m_retired;
+	bool m_running {false};
+	bool m_quit {false};
+};
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string>
+
+#include "jobboard.h"
+
+enum
+{
+	slot_free = 0,
+	slot_closed,
+	slot_open
+};
+
+static thread_local bool t_member = false;
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+void *jobboard::as(const char *ifid)
+{
+	if (std::string(ifid) == IFID_PLUM_OBJECT || std::string(ifid) == IFID_PLUM_JOBS)
+	{
+		return static_cast<plum::ijobs *>(this);
+	}
+
+	return nullptr;
+}
+
+void jobboard::set_threads(uint32_t threads)
+{
+	m_threads = threads ? threads : 1;
+}
+
+uint32_t jobboard::count_threads()
+{
+	return m_threads;
+}
+
+// with every slot taken the batch runs on the caller alone
+
+void jobboard::run_jobs(job fn, void *arg, uint32_t count)
+{
+	slot *s = nullptr;
+
+	for (auto &k : m_slots)
+	{
+		if (!t_member)
+		{
+			break;
+		}
+
+		uint32_t expected = slot_free;
+
+		if (k.state.compare_exchange_strong(expected, slot_closed))
+		{
+			s = &k;
+			break;
+		}
+	}
+
+	if (s == nullptr || m_threads < 2 || !t_member)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			fn(arg, i);
+		}
+
+		if (s) s->state.store(slot_free);
+		return;
+	}
+
+	s->fn = fn;
+	s->arg = arg;
+	s->count = count;
+	s->next.store(0);
+	s->done.store(0);
+	s->state.store(slot_open);
+	m_open.fetch_add(1);
+
+	while (work(*s))
+	{
+	}
+
+	while (s->done.load() < count)
+	{
+		cpu_relax();
+	}
+
+	// a helper may still be looking at the slot, it leaves when it sees it closed
+
+	m_open.fetch_sub(1);
+	s->state.store(slot_closed);
+
+	while (s->users.load() != 0)
+	{
+		cpu_relax();
+	}
+
+	s->state.store(slot_free);
+}
+
+// helpers announce themselves before they look at the batch, the owner closes
+// the slot before it waits for them to go: seq_cst on both sides
+
+bool jobboard::work(slot &s)
+{
+	s.users.fetch_add(1);
+
+	bool ran = false;
+
+	if (s.state.load() == slot_open)
+	{
+		uint32_t i = s.next.fetch_add(1);
+
+		if (i < s.count)
+		{
+			s.fn(s.arg, i);
+			s.done.fetch_add(1);
+			ran = true;
+		}
+	}
+
+	s.users.fetch_sub(1);
+	return ran;
+}
+
+void jobboard::join(bool member)
+{
+	t_member = member;
+}
+
+bool jobboard::help()
+{
+	if (m_open.load(std::memory_order_relaxed) == 0)
+	{
+		return false;
+	}
+
+	for (auto &s : m_slots)
+	{
+		if (s.state.load(std::memory_order_relaxed) == slot_open && work(s))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include "plum.h"
+#include "plumext.h"
+
+// the jobs plugins submit from inside a graph step. the caller works through
+// its own batch, the workers that run out of steps help with any open batch,
+// so nothing waits on a worker that is busy with the caller's graph.
+
+#define JOB_SLOTS 16
+
+class jobboard : public plum::ijobs
+{
+public:
+	// lives as long as the mixer, the references are not counted
+	void reference() override {}
+	void release() override {}
+	void *as(const char *ifid) override;
+
+	void set_threads(uint32_t threads);
+	uint32_t count_threads() override;
+	void run_jobs(job fn, void *arg, uint32_t count) override;
+
+	// runs one job of an open batch, false when there was none
+	bool help();
+
+	// the threads of a parallel run mark themselves, the others never post
+	// a batch: nobody would help them
+	static void join(bool member);
+
+private:
+	struct slot
+	{
+		std::atomic<uint32_t> state {0};
+		std::atomic<uint32_t> users {0};
+		std::atomic<uint32_t> next {0};
+		std::atomic<uint32_t> done {0};
+
+		job fn {nullptr};
+		void *arg {nullptr};
+		uint32_t count {0};
+	};
+
+	bool work(slot &s);
+
+	slot m_slots[JOB_SLOTS];
+	std::atomic<uint32_t> m_open {0};
+	uint32_t m_threads {1};
+};
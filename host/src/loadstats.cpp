@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <time.h>
+#include <algorithm>
+
+#include "loadstats.h"
+
+uint64_t load_clock()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static void add(std::atomic<uint64_t> &counter, uint64_t value)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void loadstats::record(uint32_t nframes, uint64_t start, uint64_t end)
+{
+	uint64_t ns = end - start;
+
+	last_ns.store(ns, std::memory_order_relaxed);
+	last_end.store(end, std::memory_order_relaxed);
+
+	add(calls, 1);
+	add(frames, nframes);
+	add(total_ns, ns);
+
+	if (ns > max_ns.load(std::memory_order_relaxed))
+	{
+		max_ns.store(ns, std::memory_order_relaxed);
+	}
+
+	uint32_t rate = samplerate.load(std::memory_order_relaxed);
+
+	if (rate && nframes)
+	{
+		uint64_t budget = uint64_t(nframes) * 1000000000ull / rate;
+		uint64_t bucket = budget ? ns * 10 / budget : LOAD_BUCKETS - 1;
+		add(histogram[std::min<uint64_t>(bucket, LOAD_BUCKETS - 1)], 1);
+	}
+}
+
+void loadstats::count(uint32_t nframes, const uint64_t *before, const uint64_t *after)
+{
+	add(counted_frames, nframes);
+
+	for (int i = 0; i < PERF_COUNTERS; ++i)
+	{
+		add(counters[i], after[i] - before[i]);
+	}
+}
+
+void loadstats::read(nodeload &l) const
+{
+	l.samplerate = samplerate.load(std::memory_order_relaxed);
+	l.calls = calls.load(std::memory_order_relaxed);
+	l.frames = frames.load(std::memory_order_relaxed);
+	l.total_ns = total_ns.load(std::memory_order_relaxed);
+	l.max_ns = max_ns.load(std::memory_order_relaxed);
+
+	for (int i = 0; i < LOAD_BUCKETS; ++i)
+	{
+		l.histogram[i] = histogram[i].load(std::memory_order_relaxed);
+	}
+
+	l.counted_frames = counted_frames.load(std::memory_order_relaxed);
+	l.dropped_events = dropped_events.load(std::memory_order_relaxed);
+
+	for (int i = 0; i < PERF_COUNTERS; ++i)
+	{
+		l.counters[i] = counters[i].load(std::memory_order_relaxed);
+	}
+}
+
+double nodeload::mean_ns() const
+{
+	return calls ? double(total_ns) / calls : 0;
+}
+
+double nodeload::load() const
+{
+	return frames && samplerate ? total_ns / (frames * 1e9 / samplerate) : 0;
+}
+
+// the counters are not read atomically together, a load can be slightly off
+
+double nodeload::load_since(const nodeload &before) const
+{
+	if (frames <= before.frames || total_ns < before.total_ns || samplerate == 0)
+	{
+		return 0;
+	}
+
+	return (total_ns - before.total_ns) / ((frames - before.frames) * 1e9 / samplerate);
+}
+
+perfratios nodeload::ratios() const
+{
+	return perf_ratios(counters, counted_frames);
+}
+
+perfratios nodeload::ratios_since(const nodeload &before) const
+{
+	if (counted_frames <= before.counted_frames)
+	{
+		return perfratios();
+	}
+
+	uint64_t delta[PERF_COUNTERS];
+
+	for (int i = 0; i < PERF_COUNTERS; ++i)
+	{
+		delta[i] = counters[i] - before.counters[i];
+	}
+
+	return perf_ratios(delta, counted_frames - before.counted_frames);
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "perfcounters.h"
+
+// calls are counted by the share of the block duration they took, in steps
+// of 10%. the last bucket is over budget.
+#define LOAD_BUCKETS 11
+
+// a copy of the counters of one node, the totals since it was created
+struct nodeload
+{
+	uint32_t id {0};
+	int32_t slot {-1};
+	std::string name;
+
+	uint32_t samplerate {0};
+	uint64_t calls {0};
+	uint64_t frames {0};
+	uint64_t total_ns {0};
+	uint64_t max_ns {0};
+	uint64_t histogram[LOAD_BUCKETS] {};
+
+	// sounding voices, for the plugins that tell
+	uint32_t voices {0};
+
+	// events the re-blocking adapter had no room for
+	uint64_t dropped_events {0};
+
+	// hardware counters of the calls made while they were enabled
+	uint64_t counted_frames {0};
+	uint64_t counters[PERF_COUNTERS] {};
+
+	// time per call, and time over the duration of the frames processed
+	double mean_ns() const;
+	double load() const;
+	double load_since(const nodeload &before) const;
+	perfratios ratios() const;
+	perfratios ratios_since(const nodeload &before) const;
+};
+
+
+// time spent in a node. only the thread running the node writes, so the
+// counters are plain relaxed stores and anyone can read them.
+
+struct loadstats
+{
+	std::atomic<uint32_t> samplerate {0};
+	std::atomic<uint64_t> calls {0};
+	std::atomic<uint64_t> frames {0};
+	std::atomic<uint64_t> total_ns {0};
+	std::atomic<uint64_t> max_ns {0};
+	std::atomic<uint64_t> histogram[LOAD_BUCKETS] {};
+
+	// the latest call
+	std::atomic<uint64_t> last_ns {0};
+	std::atomic<uint64_t> last_end {0};
+
+	std::atomic<uint64_t> counted_frames {0};
+	std::atomic<uint64_t> counters[PERF_COUNTERS] {};
+
+	std::atomic<uint64_t> dropped_events {0};
+
+	void record(uint32_t nframes, uint64_t start, uint64_t end);
+	void count(uint32_t nframes, const uint64_t *before, const uint64_t *after);
+	void read(nodeload &l) const;
+};
+
+// raw monotonic clock, not slewed by ntp
+uint64_t load_clock();
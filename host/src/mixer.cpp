@@ -0,0 +1,533 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <pthread.h>
+
+#include "mixer.h"
+#include "tracer.h"
+#include "perfcounters.h"
+#include "rtcheck.h"
+
+
+mixer::mixer(uint32_t tracks)
+{
+	for (uint32_t i = 0; i < tracks; ++i)
+	{
+		m_tracks.emplace_back(new mixtrack);
+		m_tracks.back()->engine.set_housekeeper(&m_house);
+	}
+
+	m_jobs.resize(tracks);
+	m_live.resize(tracks);
+	m_scheduler.resize(1);
+	m_scheduler.set_jobs(&m_board);
+
+	sem_init(&m_ahead_wake, 0, 0);
+}
+
+mixer::~mixer()
+{
+	stop();
+	sem_destroy(&m_ahead_wake);
+}
+
+void mixer::start(uint32_t workers)
+{
+	m_house.start();
+	m_workers.start(workers);
+	m_scheduler.resize(m_workers.size());
+	m_board.set_threads(m_workers.size());
+	start_ahead();
+}
+
+// the render-ahead thread runs just below the workers
+
+void mixer::set_priority(int priority)
+{
+	m_workers.set_priority(priority);
+	m_ahead_priority = priority - 1;
+	set_ahead_priority();
+}
+
+void mixer::set_ahead_priority()
+{
+	if (m_ahead.joinable() && m_ahead_priority > 0)
+	{
+		sched_param param;
+		param.sched_priority = m_ahead_priority;
+
+		if (pthread_setschedparam(m_ahead.native_handle(), SCHED_FIFO, &param))
+		{
+			printf("MIXER: can't set realtime priority %d\n", m_ahead_priority);
+		}
+	}
+}
+
+void mixer::stop()
+{
+	stop_ahead();
+	m_workers.stop();
+	m_scheduler.resize(1);
+	m_board.set_threads(1);
+	m_house.stop();
+}
+
+void mixer::set_render_ahead(uint32_t block)
+{
+	m_block = block;
+}
+
+// the largest block a plugin can be asked to process
+
+uint32_t mixer::max_block()
+{
+	return std::max(m_buffersize, m_block);
+}
+
+void mixer::start_ahead()
+{
+	if (m_block == 0 || m_ahead.joinable())
+	{
+		return;
+	}
+
+	m_ahead_quit = false;
+	m_ahead = std::thread(&mixer::render_ahead, this);
+	set_ahead_priority();
+}
+
+void mixer::stop_ahead()
+{
+	if (!m_ahead.joinable())
+	{
+		return;
+	}
+
+	m_ahead_quit = true;
+	sem_post(&m_ahead_wake);
+	m_ahead.join();
+}
+
+// fills the ring of every track in ahead mode, one block at a time.
+// rendering is raised before the mode is checked again, so the audio 
+// callback never renders a track while this thread does.
+
+void mixer::render_ahead()
+{
+	trace_thread("render ahead");
+	perf_thread();
+	m_ahead_buffer.resize(m_block * 2);
+	float *outs[2] {m_ahead_buffer.data(), m_ahead_buffer.data() + m_block};
+
+	while (!m_ahead_quit)
+	{
+		bool progress = false;
+
+		for (auto &t : m_tracks)
+		{
+			if (t->mode.load() != track_ahead || t->ring.space() < m_block)
+			{
+				continue;
+			}
+
+			t->rendering.store(true);
+
+			if (t->mode.load() == track_ahead)
+			{
+				tracescope trace("ahead", "block");
+				rtscope rt;
+				render(*t, m_block, outs);
+				t->ring.write(outs, m_block);
+				progress = true;
+			}
+
+			t->rendering.store(false);
+		}
+
+		if (!progress)
+		{
+			sem_wait(&m_ahead_wake);
+		}
+	}
+}
+
+void mixer::render(mixtrack &t, uint32_t nframes, float **outs)
+{
+	schedjob job {t.engine.read_lock(), outs, &t.busy, nullptr, 0};
+	m_scheduler.run_serial(&job, 1, nframes);
+	t.engine.read_unlock();
+}
+
+// late events were due in an earlier callback, they play at the start of this one
+
+void mixer::hold(mixtrack &t, const plum_event *events, uint32_t count, bool late)
+{
+	for (uint32_t k = 0; k < count && t.held.size() < t.held.capacity(); ++k)
+	{
+		t.held.push_back(events[k]);
+
+		if (late)
+		{
+			t.held.back().frame = 0;
+		}
+	}
+}
+
+void mixer::edit(housekeeper::job j)
+{
+	m_house.post(std::move(j));
+}
+
+void mixer::flush()
+{
+	m_house.flush();
+}
+
+uint32_t mixer::count_tracks()
+{
+	return m_tracks.size();
+}
+
+track_engine &mixer::track(uint32_t index)
+{
+	return m_tracks[index]->engine;
+}
+
+void mixer::set_armed(uint32_t index)
+{
+	m_armed = index;
+}
+
+void mixer::set_parallel(bool on)
+{
+	m_parallel = on;
+}
+
+uint32_t mixer::count_workers()
+{
+	return m_workers.size();
+}
+
+jobboard *mixer::board()
+{
+	return &m_board;
+}
+
+// midi events received since start
+uint64_t mixer::count_midi_events()
+{
+	return m_midi_events.load(std::memory_order_relaxed);
+}
+
+// fraction of the period spent rendering each track since the previous call
+
+void mixer::track_loads(std::vector<float> &loads)
+{
+	uint64_t frames = m_frames.load();
+	double period = 0;
+
+	if (frames > m_last_frames && m_samplerate)
+	{
+		period = (frames - m_last_frames) * 1e9 / m_samplerate;
+	}
+
+	m_last_frames = frames;
+	loads.resize(m_tracks.size());
+
+	for (size_t i = 0; i < m_tracks.size(); ++i)
+	{
+		auto &t = *m_tracks[i];
+		uint64_t busy = t.busy.load();
+
+		loads[i] = period > 0 ? (busy - t.last_busy) / period : 0;
+		t.last_busy = busy;
+	}
+}
+
+void mixer::set_xrunlog(xrunlog *log)
+{
+	m_xrunlog = log;
+}
+
+// snapshot of the counters of every node of a track, see loadstats.h
+
+void mixer::node_loads(uint32_t track, std::vector<nodeload> &loads)
+{
+	m_tracks[track]->engine.loads(loads);
+}
+
+// the tracks are not aligned with each other, the slowest one is reported
+
+uint32_t mixer::latency()
+{
+	uint32_t l = 0;
+
+	for (auto &t : m_tracks)
+	{
+		l = std::max(l, t->engine.latency());
+	}
+
+	return l;
+}
+
+// every track goes back to live, the render-ahead thread is paused meanwhile
+
+void mixer::reset(uint32_t buffersize, uint32_t samplerate)
+{
+	bool ahead = m_ahead.joinable();
+	stop_ahead();
+
+	m_samplerate = samplerate;
+	m_buffersize = buffersize;
+
+	uint32_t size = max_block();
+
+	for (auto &t : m_tracks)
+	{
+		t->engine.reset(size, samplerate, buffersize);
+		t->buffer.resize(size * 2);
+		t->outs[0] = t->buffer.data();
+		t->outs[1] = t->buffer.data() + size;
+
+		t->mode = track_live;
+		t->rendering = false;
+		t->held.clear();
+		t->held.reserve(4 * HOST_EVENTS);
+
+		if (m_block)
+		{
+			t->ring.resize(2 * (m_block + buffersize));
+		}
+	}
+
+	if (ahead)
+	{
+		start_ahead();
+	}
+}
+
+void mixer::process(uint32_t nframes, const plum_event *events, uint32_t count, 
+	float **ins, float **outs)
+{
+	// the first track renders straight into the output, the others are added.
+	// the events go to the armed track.
+
+	uint32_t armed = m_armed;
+	uint32_t jobs = 0;
+	uint64_t t0 = m_xrunlog ? load_clock() : 0;
+
+	// one track primes at a time, the others stay live until their turn, so
+	// going to render-ahead costs one extra period per callback
+
+	bool priming = std::any_of(m_tracks.begin(), m_tracks.end(), 
+		[](const std::unique_ptr<mixtrack> &t) {return t->mode.load() == track_priming;});
+
+	for (uint32_t i = 0; i < m_tracks.size(); ++i)
+	{
+		auto &t = *m_tracks[i];
+		bool ahead = m_block && i != armed;
+		uint32_t mode = t.mode.load();
+
+		if (ahead && mode == track_live && !priming)
+		{
+			mode = track_priming;
+			priming = true;
+		}
+
+		if (ahead && mode == track_draining) mode = track_ahead;
+
+		// the armed track must not wait for its ring to play its events. the
+		// ring is dropped unless the render-ahead thread is inside a block of
+		// the track, the mode is stored first so that it takes no other.
+
+		if (!ahead && mode != track_live)
+		{
+			t.mode.store(track_draining);
+			mode = t.rendering.load() ? track_draining : track_live;
+
+			if (mode == track_live)
+			{
+				t.ring.skip();
+			}
+		}
+
+		t.mode.store(mode);
+
+		const plum_event *e = i == armed ? events : nullptr;
+		uint32_t n = i == armed ? count : 0;
+
+		if (i != armed)
+		{
+			t.held.clear();
+		}
+
+		if (i == armed && (mode != track_live || !t.held.empty()))
+		{
+			hold(t, events, count, mode != track_live);
+			e = t.held.data();
+			n = t.held.size();
+		}
+
+		if (mode == track_live)
+		{
+			m_live[jobs] = i;
+			m_jobs[jobs++] = {t.engine.read_lock(), i == 0 ? outs : t.outs, &t.busy, e, n};
+		}
+	}
+
+	if (m_parallel)
+	{
+		m_scheduler.run(m_workers, m_jobs.data(), jobs, nframes);
+	}
+	else
+	{
+		m_scheduler.run_serial(m_jobs.data(), jobs, nframes);
+	}
+
+	for (uint32_t k = 0; k < jobs; ++k)
+	{
+		auto &t = *m_tracks[m_live[k]];
+		auto p = m_jobs[k].program;
+		t.silent = p->silent();
+
+		// the nodes that ran in this callback, the sleeping ones did not
+
+		for (uint32_t s = 0; m_xrunlog && s < p->count_steps(); ++s)
+		{
+			auto item = p->step_item(s);
+
+			if (item->load.last_end.load(std::memory_order_relaxed) >= t0)
+			{
+				m_xrunlog->node(m_live[k], item->name.c_str(), item->load.last_ns.load(std::memory_order_relaxed));
+			}
+		}
+
+		t.engine.read_unlock();
+
+		if (m_live[k] == armed)
+		{
+			t.held.clear();
+		}
+	}
+
+	// the tracks that are not live come out of their ring. priming renders
+	// two periods per callback, one of them ahead, until the ring holds a
+	// block. draining plays the ring until the render-ahead thread is done
+	// with the track, then the period is finished live without events: they
+	// are held for the next callback.
+
+	bool wake = false;
+
+	for (uint32_t i = 0; i < m_tracks.size(); ++i)
+	{
+		auto &t = *m_tracks[i];
+		uint32_t mode = t.mode.load();
+		float **target = i == 0 ? outs : t.outs;
+
+		if (mode == track_live)
+		{
+			continue;
+		}
+
+		t.silent = false;
+
+		if (mode == track_priming)
+		{
+			for (int k = 0; k < 2; ++k)
+			{
+				render(t, nframes, t.outs);
+				t.ring.write(t.outs, nframes);
+			}
+
+			t.ring.read(target, nframes);
+
+			if (t.ring.available() >= m_block)
+			{
+				t.mode.store(track_ahead);
+				wake = true;
+			}
+
+			continue;
+		}
+
+		uint32_t n = std::min(t.ring.available(), nframes);
+		t.ring.read(target, n);
+
+		if (mode == track_ahead)
+		{
+			wake = true;
+		}
+
+		float *rest[2] {target[0] + n, target[1] + n};
+
+		if (mode == track_draining && !t.rendering.load())
+		{
+			// nothing is added anymore, take what the last block left
+
+			uint32_t m = std::min(t.ring.available(), nframes - n);
+			t.ring.read(rest, m);
+			n += m;
+			rest[0] += m;
+			rest[1] += m;
+
+			if (n < nframes)
+			{
+				render(t, nframes - n, rest);
+			}
+
+			if (t.ring.available() == 0)
+			{
+				t.mode.store(track_live);
+			}
+		}
+		else if (n < nframes)
+		{
+			std::fill(rest[0], rest[0] + nframes - n, 0);
+			std::fill(rest[1], rest[1] + nframes - n, 0);
+			t.underruns.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	if (wake)
+	{
+		sem_post(&m_ahead_wake);
+	}
+
+	// a silent track adds nothing
+
+	for (size_t k = 1; k < m_tracks.size(); ++k)
+	{
+		auto &t = *m_tracks[k];
+
+		if (t.silent) continue;
+
+		for (uint32_t i = 0; i < nframes; ++i)
+		{
+			outs[0][i] += t.outs[0][i];
+			outs[1][i] += t.outs[1][i];
+		}
+	}
+
+	m_frames.fetch_add(nframes, std::memory_order_relaxed);
+	m_midi_events.fetch_add(count, std::memory_order_relaxed);
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <semaphore.h>
+
+#include "engine.h"
+#include "scheduler.h"
+#include "workers.h"
+#include "housekeeper.h"
+#include "ring.h"
+#include "xrunlog.h"
+
+// how a track is rendered. live: in the audio callback. ahead: by the
+// render-ahead thread into the ring. priming hands over from live to ahead
+// without a gap, the audio callback renders and reads the ring. one track
+// primes at a time. an armed track goes live at once and drops its ring,
+// draining only while the render-ahead thread finishes a block of it.
+enum trackmode
+{
+	track_live = 0,
+	track_priming,
+	track_ahead,
+	track_draining
+};
+
+struct mixtrack
+{
+	track_engine engine;
+	std::vector<float> buffer;
+	float *outs[2] {nullptr, nullptr};
+	bool silent {true};
+
+	std::atomic<uint64_t> busy {0};		// ns spent rendering
+	uint64_t last_busy {0};
+
+	audioring ring;
+	std::atomic<uint32_t> mode {track_live};
+	std::atomic<bool> rendering {false};
+	std::atomic<uint32_t> underruns {0};
+
+	// events for the armed track while it drains, played once it is live
+	std::vector<plum_event> held;
+};
+
+
+// N independent tracks summed on a mix bus. the nodes of all the live tracks
+// are rendered in parallel by the scheduler. with render-ahead on, the tracks
+// that are not armed render in large blocks ahead of time and the callback
+// only copies their audio out.
+
+class mixer : public engine
+{
+public:
+	mixer(uint32_t tracks);
+	~mixer();
+
+	void start(uint32_t workers);
+	void stop();
+	void set_priority(int priority);
+
+	// block size of the render-ahead thread, 0 turns it off. call before start().
+	void set_render_ahead(uint32_t block);
+	uint32_t max_block();
+
+	// track edits go through the housekeeper, so does anything
+	// that must run after them. flush waits for all of it.
+	void edit(housekeeper::job j);
+	void flush();
+
+	void reset(uint32_t buffersize, uint32_t samplerate) override;
+	uint32_t latency() override;
+	void process(uint32_t nframes, const plum_event *events, uint32_t count, 
+		float **ins, float **outs) override;
+
+	uint32_t count_tracks();
+	track_engine &track(uint32_t index);
+	void set_armed(uint32_t index);
+
+	uint32_t count_workers();
+	uint64_t count_midi_events();
+
+	// where the plugins submit their jobs, see plum::ijobs
+	jobboard *board();
+	void track_loads(std::vector<float> &loads);
+	void node_loads(uint32_t track, std::vector<nodeload> &loads);
+
+	// the live nodes of each callback go to the log, set before start()
+	void set_xrunlog(xrunlog *);
+	void set_parallel(bool);
+
+private:
+	void start_ahead();
+	void set_ahead_priority();
+	void stop_ahead();
+	void render_ahead();
+	void render(mixtrack &t, uint32_t nframes, float **outs);
+	void hold(mixtrack &t, const plum_event *events, uint32_t count, bool late);
+
+	std::vector<std::unique_ptr<mixtrack>> m_tracks;
+	std::vector<schedjob> m_jobs;
+	std::vector<uint32_t> m_live;
+	workerpool m_workers;
+	scheduler m_scheduler;
+	jobboard m_board;
+	housekeeper m_house;
+
+	uint32_t m_samplerate {0};
+	uint32_t m_buffersize {0};
+
+	uint32_t m_block {0};
+	int m_ahead_priority {0};
+	std::thread m_ahead;
+	std::atomic<bool> m_ahead_quit {false};
+	sem_t m_ahead_wake;
+	std::vector<float> m_ahead_buffer;
+	std::atomic<uint32_t> m_armed {0};
+	std::atomic<bool> m_parallel {true};
+	xrunlog *m_xrunlog {nullptr};
+
+	std::atomic<uint64_t> m_frames {0};
+	std::atomic<uint64_t> m_midi_events {0};
+	uint64_t m_last_frames {0};
+};
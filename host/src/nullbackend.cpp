@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "nullbackend.h"
+#include "tracer.h"
+#include "perfcounters.h"
+#include "rtcheck.h"
+
+// realtime priority asked for the timer thread
+static const int null_priority = 70;
+
+static void add_ns(timespec &ts, uint64_t ns)
+{
+	ts.tv_nsec += ns;
+
+	while (ts.tv_nsec >= 1000000000)
+	{
+		ts.tv_nsec -= 1000000000;
+		++ts.tv_sec;
+	}
+}
+
+static bool before(const timespec &a, const timespec &b)
+{
+	return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+static int64_t diff_ns(const timespec &a, const timespec &b)
+{
+	return (int64_t(a.tv_sec) - b.tv_sec) * 1000000000ll + (a.tv_nsec - b.tv_nsec);
+}
+
+
+nullbackend::nullbackend(const backendoptions &options)
+{
+	auto o = options.find("rate");
+	if (o != options.end()) m_samplerate = std::stoul(o->second);
+
+	o = options.find("block");
+	if (o != options.end()) m_buffersize = std::stoul(o->second);
+}
+
+nullbackend::~nullbackend()
+{
+	stop();
+}
+
+uint32_t nullbackend::samplerate()
+{
+	return m_samplerate;
+}
+
+uint32_t nullbackend::buffersize()
+{
+	return m_buffersize;
+}
+
+int nullbackend::priority()
+{
+	return m_priority;
+}
+
+bool nullbackend::start(const char *id, engine *e)
+{
+	stop();
+
+	m_engine = e;
+	m_buffer.assign(m_buffersize * 2, 0);
+
+	if (m_engine)
+	{
+		m_engine->reset(m_buffersize, m_samplerate);
+	}
+
+	m_quit = false;
+	m_thread = std::thread(&nullbackend::loop, this);
+
+	sched_param param;
+	param.sched_priority = null_priority;
+
+	if (pthread_setschedparam(m_thread.native_handle(), SCHED_FIFO, &param) == 0)
+	{
+		m_priority = null_priority;
+	}
+	else
+	{
+		printf("NULL BACKEND: can't set realtime priority %d\n", null_priority);
+	}
+
+	printf("NULL BACKEND: %u Hz, %u frames\n", m_samplerate, m_buffersize);
+	return true;
+}
+
+void nullbackend::stop()
+{
+	if (!m_thread.joinable())
+	{
+		return;
+	}
+
+	m_quit = true;
+	m_thread.join();
+
+	printf("NULL BACKEND: %lu periods, %lu late\n", 
+		(unsigned long)m_cycles, (unsigned long)m_late);
+}
+
+// one period per tick of an absolute timer. a late period skips the ticks
+// it overran, the ones after it stay on the grid
+
+void nullbackend::loop()
+{
+	trace_thread("null");
+	perf_thread();
+
+	float *outs[2] {m_buffer.data(), m_buffer.data() + m_buffersize};
+	uint64_t period = uint64_t(m_buffersize) * 1000000000ull / m_samplerate;
+
+	timespec next;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while (!m_quit)
+	{
+		timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		if (m_xrunlog)
+		{
+			m_xrunlog->begin(m_buffersize, m_samplerate, diff_ns(now, next));
+		}
+
+		add_ns(next, period);
+
+		if (m_engine)
+		{
+			tracescope trace("audio", "callback");
+			rtscope rt;
+			m_engine->process(m_buffersize, nullptr, 0, nullptr, outs);
+		}
+
+		if (m_xrunlog)
+		{
+			m_xrunlog->end();
+		}
+
+		++m_cycles;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		// a late period is what jack would report as an xrun
+
+		if (before(next, now))
+		{
+			++m_late;
+
+			if (m_xrunlog)
+			{
+				m_xrunlog->xrun(diff_ns(now, next) * 1e-3f);
+			}
+
+			add_ns(next, (diff_ns(now, next) / period + 1) * period);
+		}
+
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+	}
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "backend.h"
+
+// drives the engine from a realtime timer thread, the output is discarded.
+// engine cost without any audio server in the way.
+
+class nullbackend : public backend
+{
+public:
+	nullbackend(const backendoptions &options);
+	~nullbackend();
+
+	bool start(const char *id, engine *e) override;
+	void stop() override;
+
+	uint32_t samplerate() override;
+	uint32_t buffersize() override;
+	int priority() override;
+
+private:
+	void loop();
+
+	uint32_t m_samplerate {48000};
+	uint32_t m_buffersize {256};
+	int m_priority {0};
+
+	engine *m_engine {nullptr};
+	std::thread m_thread;
+	std::atomic<bool> m_quit {false};
+
+	std::vector<float> m_buffer;
+
+	// periods that took longer than their duration
+	uint64_t m_cycles {0};
+	uint64_t m_late {0};
+};
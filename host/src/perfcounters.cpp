@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfcounters.h"
+
+std::atomic<bool> g_perf {false};
+
+static const uint64_t s_events[PERF_COUNTERS] = 
+{
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES,
+	PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+// one group per thread, the first counter leads
+
+struct perfgroup
+{
+	int fd[PERF_COUNTERS];
+	int state {0};		// 0 not tried, 1 open, -1 failed
+
+	perfgroup()
+	{
+		for (auto &f : fd) f = -1;
+	}
+
+	~perfgroup()
+	{
+		close();
+	}
+
+	bool open();
+	void close();
+};
+
+static thread_local perfgroup t_group;
+
+bool perfgroup::open()
+{
+	for (int i = 0; i < PERF_COUNTERS; ++i)
+	{
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = s_events[i];
+		attr.disabled = i == 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fd[0], 0);
+
+		if (fd[i] < 0)
+		{
+			close();
+			state = -1;
+			return false;
+		}
+	}
+
+	ioctl(fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+	state = 1;
+	return true;
+}
+
+void perfgroup::close()
+{
+	for (int i = PERF_COUNTERS - 1; i >= 0; --i)
+	{
+		if (fd[i] >= 0)
+		{
+			::close(fd[i]);
+			fd[i] = -1;
+		}
+	}
+
+	state = 0;
+}
+
+bool perf_start()
+{
+	if (t_group.state == 0 && !t_group.open())
+	{
+		printf("PERF: no hardware counters (%s), timing only\n", strerror(errno));
+		return false;
+	}
+
+	g_perf = t_group.state == 1;
+	return g_perf;
+}
+
+void perf_stop()
+{
+	g_perf = false;
+}
+
+void perf_thread()
+{
+	if (perf_enabled() && t_group.state == 0)
+	{
+		t_group.open();
+	}
+}
+
+// the group is read with one syscall that takes no lock and does not sleep,
+// the open and its ioctls are what perf_thread keeps off the callbacks. it
+// is a raw syscall, not read(): rtcheck only sees the read() wrapper.
+
+bool perf_read(uint64_t values[PERF_COUNTERS])
+{
+	if (t_group.state != 1)
+	{
+		return false;
+	}
+
+	struct
+	{
+		uint64_t nr;
+		uint64_t values[PERF_COUNTERS];
+	} group;
+
+	if (syscall(SYS_read, t_group.fd[0], &group, sizeof(group)) != sizeof(group))
+	{
+		return false;
+	}
+
+	for (int i = 0; i < PERF_COUNTERS; ++i)
+	{
+		values[i] = group.values[i];
+	}
+
+	return true;
+}
+
+perfratios perf_ratios(const uint64_t counters[PERF_COUNTERS], uint64_t frames)
+{
+	perfratios r;
+
+	uint64_t cycles = counters[PERF_CYCLES];
+	uint64_t instructions = counters[PERF_INSTRUCTIONS];
+
+	if (cycles)
+	{
+		r.ipc = double(instructions) / cycles;
+	}
+
+	if (frames)
+	{
+		r.cycles_per_frame = double(cycles) / frames;
+	}
+
+	if (instructions)
+	{
+		r.cache_mpki = counters[PERF_CACHE_MISSES] * 1000.0 / instructions;
+		r.branch_mpki = counters[PERF_BRANCH_MISSES] * 1000.0 / instructions;
+	}
+
+	return r;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+// hardware counters of the calling thread, read around every node when
+// enabled. each thread that renders opens its own group with perf_thread where
+// it starts, never in a callback. without perf_event_open (a vm,
+// perf_event_paranoid) perf_start fails and the load stats keep only the clock.
+
+enum perfcounter
+{
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_CACHE_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_COUNTERS
+};
+
+extern std::atomic<bool> g_perf;
+
+inline bool perf_enabled()
+{
+	return g_perf.load(std::memory_order_relaxed);
+}
+
+// tries the counters on the calling thread, enables them if they work.
+// call it before the rendering threads start.
+bool perf_start();
+void perf_stop();
+
+// opens the group of the calling thread when the counters are enabled
+void perf_thread();
+
+// false when this thread has no counters
+bool perf_read(uint64_t values[PERF_COUNTERS]);
+
+
+// what the counters say about a stretch of frames: a low ipc with many cache
+// misses is memory bound, a high ipc is compute bound
+
+struct perfratios
+{
+	double ipc {0};
+	double cycles_per_frame {0};
+	double cache_mpki {0};		// misses per thousand instructions
+	double branch_mpki {0};
+};
+
+perfratios perf_ratios(const uint64_t counters[PERF_COUNTERS], uint64_t frames);
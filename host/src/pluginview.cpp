@@ -21,6 +21,7 @@
  */
 
 #include "pluginview.h"
+#include "tracer.h"
 
 #include "plumhelpers.h"
 
@@ -54,6 +55,8 @@ void pluginview::on_size_allocate(Gtk::Allocation& a)
 
 bool pluginview::on_draw(const ::Cairo::RefPtr<::Cairo::Context>& cr)
 {
+	tracescope trace("gui", "on_draw");
+
 	auto cr2 = ::Cairo::Context::create(m_surface);
 	cr2->set_source_rgb(1, 1, 1);
 	cr2->paint();
@@ -61,6 +64,7 @@ bool pluginview::on_draw(const ::Cairo::RefPtr<::Cairo::Context>& cr)
 
 	if (m_plugin_window)
 	{
+		tracescope trace_render("gui", "window render");
 		m_plugin_window->render(m_surface->get_data());
 	}
 
@@ -0,0 +1,776 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#include "plugincatalog.h"
+#include "headlesshost.h"
+#include "engine.h"
+#include "scheduler.h"
+#include "workers.h"
+
+// plugin benchmark: every plugin of a library, or the ones named, is driven
+// with synthetic midi and noise over a sweep of block sizes, sample rates,
+// held notes and polyphony. the results are json, one case per line, so that
+// a later run can be compared with them.
+
+static void usage()
+{
+	printf(
+		"usage: plumbench -l library [options]\n"
+		"  -l file        plugin library\n"
+		"  -p name        plugin to measure (repeatable, default all)\n"
+		"  -n list        block sizes (default 16,64,256,1024,4096)\n"
+		"  -r list        sample rates (default 44100,48000,96000)\n"
+		"  -v list        notes held by the synths (default 1,8)\n"
+		"  -P list        synth polyphony, through DSYNTH_VOICES (default the\n"
+		"                 plugin's own)\n"
+		"  -t seconds     audio rendered per case (default 2)\n"
+		"  -g chains      also measure a graph of synth>effect chains, serial\n"
+		"                 and parallel (default 0, off)\n"
+		"  -o file        write the json results to a file (default stdout)\n"
+		"  -c file        compare with a baseline, exit 2 on a regression\n"
+		"  -T percent     regression threshold (default 10)\n"
+		"  -H             add hardware counters: ipc, cycles per sample, cache and\n"
+		"                 branch misses per 1000 instructions\n");
+}
+
+static uint64_t now_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static std::vector<uint32_t> parse_list(const std::string &s)
+{
+	std::vector<uint32_t> list;
+	std::stringstream ss(s);
+	std::string item;
+
+	while (std::getline(ss, item, ','))
+	{
+		if (!item.empty()) list.push_back(std::stoul(item));
+	}
+
+	return list;
+}
+
+
+// ------------------------------------------------------------------------------------
+// RESULTS
+// ------------------------------------------------------------------------------------
+
+struct benchcase
+{
+	std::string plugin;
+	std::string mode {"plugin"};
+	uint32_t rate {0};
+	uint32_t block {0};
+	uint32_t voices {0};
+	uint32_t polyphony {0};	// 0 for the plugin's default
+};
+
+struct benchresult
+{
+	benchcase c;
+	double ns_per_sample {0};
+	double p50_us {0};
+	double p99_us {0};
+	double max_us {0};
+	double budget {0};		// mean block time over block duration
+	double noteon_ns {0};	// "notes" cases: a note-off and note-on pair over the held block
+	double sounding {-1};	// mean voices sounding, from plum.voices, -1 without it
+
+	// with -H, when the kernel gives counters
+	bool counted {false};
+	perfratios perf;
+};
+
+static std::string key(const benchcase &c)
+{
+	return c.plugin + "|" + c.mode + "|" + std::to_string(c.rate) + "|" +
+		std::to_string(c.block) + "|" + std::to_string(c.voices) + "|" + std::to_string(c.polyphony);
+}
+
+static benchresult summarize(const benchcase &c, std::vector<uint64_t> &times)
+{
+	benchresult r;
+	r.c = c;
+
+	if (times.empty())
+	{
+		return r;
+	}
+
+	std::sort(times.begin(), times.end());
+
+	uint64_t total = 0;
+	for (auto t : times) total += t;
+
+	double mean = double(total) / times.size();
+
+	r.ns_per_sample = mean / c.block;
+	r.p50_us = times[(times.size() - 1) / 2] * 1e-3;
+	r.p99_us = times[size_t((times.size() - 1) * 0.99)] * 1e-3;
+	r.max_us = times.back() * 1e-3;
+	r.budget = mean / (c.block * 1e9 / c.rate);
+	return r;
+}
+
+static std::string to_json(const benchresult &r)
+{
+	char line[768];
+	int n = snprintf(line, sizeof(line),
+		"{\"plugin\": \"%s\", \"mode\": \"%s\", \"rate\": %u, \"block\": %u, \"voices\": %u, \"polyphony\": %u, "
+		"\"ns_per_sample\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f, \"budget\": %.5f",
+		r.c.plugin.c_str(), r.c.mode.c_str(), r.c.rate, r.c.block, r.c.voices, r.c.polyphony,
+		r.ns_per_sample, r.p50_us, r.p99_us, r.max_us, r.budget);
+
+	if (r.sounding >= 0)
+	{
+		n += snprintf(line + n, sizeof(line) - n, ", \"sounding\": %.1f", r.sounding);
+	}
+
+	if (r.c.mode == "notes")
+	{
+		n += snprintf(line + n, sizeof(line) - n, ", \"noteon_ns\": %.1f", r.noteon_ns);
+	}
+
+	if (r.counted)
+	{
+		n += snprintf(line + n, sizeof(line) - n,
+			", \"ipc\": %.3f, \"cycles_per_sample\": %.2f, \"cache_mpki\": %.3f, \"branch_mpki\": %.3f",
+			r.perf.ipc, r.perf.cycles_per_frame, r.perf.cache_mpki, r.perf.branch_mpki);
+	}
+
+	snprintf(line + n, sizeof(line) - n, "}");
+	return line;
+}
+
+// reads back what to_json wrote, one result per line
+
+static bool json_field(const std::string &line, const char *name, std::string &value)
+{
+	std::string tag = std::string("\"") + name + "\": ";
+	auto at = line.find(tag);
+	if (at == std::string::npos)
+	{
+		return false;
+	}
+
+	at += tag.size();
+
+	if (line[at] == '"')
+	{
+		auto end = line.find('"', at + 1);
+		value = line.substr(at + 1, end - at - 1);
+	}
+	else
+	{
+		auto end = line.find_first_of(",}", at);
+		value = line.substr(at, end - at);
+	}
+
+	return true;
+}
+
+static bool load_baseline(const std::string &filename, std::map<std::string, benchresult> &baseline)
+{
+	std::ifstream file(filename);
+	if (!file.is_open())
+	{
+		printf("BENCH ERROR: can't open %s\n", filename.c_str());
+		return false;
+	}
+
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		benchresult r;
+		std::string v;
+
+		if (!json_field(line, "plugin", r.c.plugin)) continue;
+		if (json_field(line, "mode", v)) r.c.mode = v;
+		if (json_field(line, "rate", v)) r.c.rate = std::stoul(v);
+		if (json_field(line, "block", v)) r.c.block = std::stoul(v);
+		if (json_field(line, "voices", v)) r.c.voices = std::stoul(v);
+		if (json_field(line, "polyphony", v)) r.c.polyphony = std::stoul(v);
+		if (json_field(line, "ns_per_sample", v)) r.ns_per_sample = std::stod(v);
+		if (json_field(line, "p99_us", v)) r.p99_us = std::stod(v);
+
+		baseline[key(r.c)] = r;
+	}
+
+	return true;
+}
+
+// a case regresses when its mean or its p99 grew by more than the threshold
+
+static uint32_t compare(const std::vector<benchresult> &results,
+	const std::map<std::string, benchresult> &baseline, double threshold)
+{
+	uint32_t regressions = 0;
+
+	for (auto &r : results)
+	{
+		auto b = baseline.find(key(r.c));
+		if (b == baseline.end())
+		{
+			continue;
+		}
+
+		double mean = b->second.ns_per_sample > 0 ?
+			100 * (r.ns_per_sample / b->second.ns_per_sample - 1) : 0;
+		double p99 = b->second.p99_us > 0 ?
+			100 * (r.p99_us / b->second.p99_us - 1) : 0;
+
+		if (mean > threshold || p99 > threshold)
+		{
+			fprintf(stderr, "REGRESSION %s %s rate %u block %u voices %u polyphony %u: mean %+.1f%%, p99 %+.1f%%\n",
+				r.c.plugin.c_str(), r.c.mode.c_str(), r.c.rate, r.c.block, r.c.voices, r.c.polyphony,
+				mean, p99);
+			++regressions;
+		}
+	}
+
+	fprintf(stderr, "%u regressions over %zu cases\n", regressions, results.size());
+	return regressions;
+}
+
+
+// ------------------------------------------------------------------------------------
+// STIMULUS
+// ------------------------------------------------------------------------------------
+
+// the synths hold a chord of voices notes, released and struck again every
+// half second so that the envelopes keep moving, or every period frames. the
+// effects get white noise.
+
+struct stimulus
+{
+	uint32_t voices {0};
+	uint32_t rate {48000};
+	uint32_t period {0};
+	uint64_t frame {0};
+	uint32_t seed {1};
+
+	void events(uint32_t nframes, std::vector<plum_event> &out)
+	{
+		out.clear();
+
+		uint64_t period = this->period ? this->period : rate / 2;
+		uint64_t next = (frame + period - 1) / period * period;
+
+		for (; next < frame + nframes; next += period)
+		{
+			uint32_t at = next - frame;
+
+			for (uint32_t v = 0; v < voices && next > 0; ++v)
+			{
+				out.push_back({at, 3, {0x80, uint8_t(36 + v % 88), 0, 0}});
+			}
+
+			for (uint32_t v = 0; v < voices; ++v)
+			{
+				out.push_back({at, 3, {0x90, uint8_t(36 + v % 88), 100, 0}});
+			}
+		}
+
+		frame += nframes;
+	}
+
+	void noise(float *buffer, uint32_t nframes)
+	{
+		for (uint32_t i = 0; i < nframes; ++i)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			buffer[i] = (int32_t(seed) >> 8) * (0.25f / 8388608.0f);
+		}
+	}
+};
+
+
+// DSynth reads its polyphony when it is created. 0 puts back what the
+// environment had when plumbench started.
+
+static void set_polyphony(uint32_t polyphony)
+{
+	static const char *initial = getenv("DSYNTH_VOICES");
+	static std::string saved = initial ? initial : "";
+
+	if (polyphony)
+	{
+		setenv("DSYNTH_VOICES", std::to_string(polyphony).c_str(), 1);
+	}
+	else if (initial)
+	{
+		setenv("DSYNTH_VOICES", saved.c_str(), 1);
+	}
+	else
+	{
+		unsetenv("DSYNTH_VOICES");
+	}
+}
+
+
+// ------------------------------------------------------------------------------------
+// PLUGIN
+// ------------------------------------------------------------------------------------
+
+// events go through midi_event at the start of the block they fall in, the
+// plugin is timed as a host would call it
+
+static benchresult bench_plugin(plugincatalog &catalog, plum::ihost *host,
+	const benchcase &c, double seconds)
+{
+	std::vector<uint64_t> times;
+
+	set_polyphony(c.polyphony);
+	auto plugin = catalog.create_plugin(c.plugin, host);
+	if (plugin == nullptr)
+	{
+		printf("BENCH ERROR: no plugin named %s\n", c.plugin.c_str());
+		return summarize(c, times);
+	}
+
+	plugin->configure(c.rate, c.block);
+	plugin->activate();
+
+	// what the synth really renders: past its polyphony the held notes steal
+	// each other's voices
+	auto voices = (plum::ivoices *)plugin->as(IFID_PLUM_VOICES);
+	uint64_t sounding = 0;
+
+	uint32_t nins = plugin->count_inputs();
+	uint32_t nouts = plugin->count_outputs();
+
+	std::vector<float> buffer((nins + nouts) * c.block);
+	std::vector<float *> ins, outs;
+
+	for (uint32_t i = 0; i < nins; ++i) ins.push_back(buffer.data() + i * c.block);
+	for (uint32_t i = 0; i < nouts; ++i) outs.push_back(buffer.data() + (nins + i) * c.block);
+
+	// "notes" strikes the chord again at the start of every block
+	stimulus s;
+	s.voices = c.voices;
+	s.rate = c.rate;
+	s.period = c.mode == "notes" ? c.block : 0;
+
+	std::vector<plum_event> events;
+
+	uint64_t blocks = std::max<uint64_t>(64, uint64_t(seconds * c.rate) / c.block);
+	uint64_t warmup = blocks / 10;
+
+	times.reserve(blocks);
+
+	// the counters are read outside the timed part
+	uint64_t counters[PERF_COUNTERS] {};
+	uint64_t c0[PERF_COUNTERS], c1[PERF_COUNTERS];
+	bool counted = perf_enabled();
+
+	for (uint64_t b = 0; b < warmup + blocks; ++b)
+	{
+		s.events(c.block, events);
+
+		for (auto in : ins)
+		{
+			s.noise(in, c.block);
+		}
+
+		counted = counted && perf_read(c0);
+		uint64_t t0 = now_ns();
+
+		for (auto &e : events)
+		{
+			plugin->midi_event(e.data);
+		}
+
+		plugin->process(c.block, ins.data(), outs.data());
+
+		uint64_t t1 = now_ns();
+		counted = counted && perf_read(c1);
+
+		if (b >= warmup)
+		{
+			times.push_back(t1 - t0);
+			sounding += voices ? voices->count_voices() : 0;
+
+			for (int i = 0; counted && i < PERF_COUNTERS; ++i)
+			{
+				counters[i] += c1[i] - c0[i];
+			}
+		}
+	}
+
+	if (voices)
+	{
+		voices->release();
+	}
+
+	plugin->deactivate();
+	plugin->release();
+
+	auto r = summarize(c, times);
+	r.sounding = voices && !times.empty() ? double(sounding) / times.size() : -1;
+	r.counted = counted;
+	r.perf = perf_ratios(counters, uint64_t(c.block) * times.size());
+	return r;
+}
+
+
+// ------------------------------------------------------------------------------------
+// GRAPH
+// ------------------------------------------------------------------------------------
+
+// chains synth>effect side by side into the track output, the same program
+// rendered by one thread and by the worker pool
+
+static void bench_graph(plugincatalog &catalog, headlesshost *host, uint32_t chains,
+	const std::string &synth, const std::string &effect, uint32_t rate, uint32_t block,
+	uint32_t voices, uint32_t polyphony, double seconds, std::vector<benchresult> &results)
+{
+	// the plugins find the board when they are created, it outlives them
+	jobboard board;
+	host->set_jobs(&board);
+
+	track_engine engine;
+	engine.reset(block, rate);
+
+	std::vector<uint32_t> nodes;
+	bool ok = true;
+
+	set_polyphony(polyphony);
+
+	for (uint32_t i = 0; i < chains && ok; ++i)
+	{
+		auto s = catalog.create_plugin(synth, host);
+		auto e = catalog.create_plugin(effect, host);
+		ok = s && e;
+
+		if (ok)
+		{
+			s->configure(rate, block);
+			e->configure(rate, block);
+
+			uint32_t a = engine.add_node(s, true);
+			uint32_t b = engine.add_node(e, false);
+
+			engine.connect(a, 0, b, 0);
+			engine.connect(a, 1, b, 1);
+			engine.connect(b, 0, graph::output, 0);
+			engine.connect(b, 1, graph::output, 1);
+
+			nodes.push_back(a);
+			nodes.push_back(b);
+		}
+
+		if (s) s->release();
+		if (e) e->release();
+	}
+
+	if (!ok || !engine.commit())
+	{
+		printf("BENCH ERROR: can't build the %s>%s graph\n", synth.c_str(), effect.c_str());
+	}
+	else
+	{
+		workerpool workers;
+		scheduler sched;
+
+		uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+		workers.start(cores - 1);
+		sched.resize(workers.size());
+		sched.set_jobs(&board);
+		board.set_threads(workers.size());
+
+		std::vector<float> buffer(block * 2);
+		float *outs[2] {buffer.data(), buffer.data() + block};
+		std::vector<plum_event> events;
+
+		uint64_t blocks = std::max<uint64_t>(64, uint64_t(seconds * rate) / block);
+		uint64_t warmup = blocks / 10;
+
+		for (int parallel = 0; parallel < 2; ++parallel)
+		{
+			benchcase c {synth + ">" + effect, "", rate, block, voices, polyphony};
+			c.mode = (parallel ? "parallel" : "serial") + std::string("-x") + std::to_string(chains);
+
+			stimulus s;
+			s.voices = voices;
+			s.rate = rate;
+
+			std::vector<uint64_t> times;
+			times.reserve(blocks);
+
+			std::vector<nodeload> before, after;
+
+			for (uint64_t b = 0; b < warmup + blocks; ++b)
+			{
+				s.events(block, events);
+
+				if (b == warmup)
+				{
+					engine.loads(before);
+				}
+
+				schedjob job {engine.read_lock(), outs, nullptr, events.data(), uint32_t(events.size())};
+				uint64_t t0 = now_ns();
+
+				if (parallel)
+				{
+					sched.run(workers, &job, 1, block);
+				}
+				else
+				{
+					sched.run_serial(&job, 1, block);
+				}
+
+				uint64_t t1 = now_ns();
+				engine.read_unlock();
+
+				if (b >= warmup)
+				{
+					times.push_back(t1 - t0);
+				}
+			}
+
+			auto r = summarize(c, times);
+
+			// all the nodes together, counted by the threads that ran them
+			engine.loads(after);
+			uint64_t counters[PERF_COUNTERS] {};
+			uint64_t frames = 0;
+
+			for (size_t i = 0; i < after.size() && i < before.size(); ++i)
+			{
+				frames += after[i].counted_frames - before[i].counted_frames;
+
+				for (int k = 0; k < PERF_COUNTERS; ++k)
+				{
+					counters[k] += after[i].counters[k] - before[i].counters[k];
+				}
+			}
+
+			r.counted = frames > 0;
+			r.perf = perf_ratios(counters, uint64_t(block) * times.size());
+			results.push_back(r);
+		}
+
+		workers.stop();
+	}
+
+	// the engine lets go of the plugins before the library is closed
+
+	for (auto n : nodes)
+	{
+		engine.remove_node(n);
+	}
+
+	engine.commit();
+	host->set_jobs(nullptr);
+}
+
+
+int main(int argc, char *argv[])
+{
+	std::string library, output, baseline;
+	std::vector<std::string> names;
+	std::vector<uint32_t> blocks {16, 64, 256, 1024, 4096};
+	std::vector<uint32_t> rates {44100, 48000, 96000};
+	std::vector<uint32_t> voices {1, 8};
+	std::vector<uint32_t> polyphonies {0};
+	double seconds = 2;
+	double threshold = 10;
+	uint32_t chains = 0;
+	bool counters = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "-H")
+		{
+			counters = true;
+			continue;
+		}
+
+		if (arg.size() != 2 || arg[0] != '-' || i + 1 >= argc)
+		{
+			usage();
+			return 1;
+		}
+
+		std::string value = argv[++i];
+
+		switch (arg[1])
+		{
+			case 'l': library = value; break;
+			case 'p': names.push_back(value); break;
+			case 'n': blocks = parse_list(value); break;
+			case 'r': rates = parse_list(value); break;
+			case 'v': voices = parse_list(value); break;
+			case 'P': polyphonies = parse_list(value); break;
+			case 't': seconds = std::stod(value); break;
+			case 'g': chains = std::stoul(value); break;
+			case 'o': output = value; break;
+			case 'c': baseline = value; break;
+			case 'T': threshold = std::stod(value); break;
+
+			default:
+				usage();
+				return 1;
+		}
+	}
+
+	if (library.empty() || blocks.empty() || rates.empty() || polyphonies.empty() ||
+		std::find(blocks.begin(), blocks.end(), 0) != blocks.end())
+	{
+		usage();
+		return 1;
+	}
+
+	std::map<std::string, benchresult> base;
+	if (!baseline.empty() && !load_baseline(baseline, base))
+	{
+		return 1;
+	}
+
+	plugincatalog catalog;
+	if (!catalog.open(library))
+	{
+		return 1;
+	}
+
+	auto synths = catalog.synth_list();
+	auto effects = catalog.effect_list();
+
+	if (names.empty())
+	{
+		names = synths;
+		names.insert(names.end(), effects.begin(), effects.end());
+	}
+
+	if (counters)
+	{
+		perf_start();
+	}
+
+	headlesshost host;
+	std::vector<benchresult> results;
+
+	// progress goes to stdout only when the json goes to a file. the synths
+	// are measured twice, holding their notes and striking them every block,
+	// the difference is what the notes cost. the polyphony sweep only applies
+	// to the synths.
+
+	for (auto &name : names)
+	{
+		bool synth = std::find(synths.begin(), synths.end(), name) != synths.end();
+		std::vector<uint32_t> counts = synth ? voices : std::vector<uint32_t> {0};
+		std::vector<uint32_t> polys = synth ? polyphonies : std::vector<uint32_t> {0};
+
+		for (auto rate : rates)
+		for (auto block : blocks)
+		for (auto p : polys)
+		for (auto v : counts)
+		{
+			size_t first = results.size();
+			results.push_back(bench_plugin(catalog, &host, {name, "plugin", rate, block, v, p}, seconds));
+
+			if (v > 0)
+			{
+				auto held = results.back();
+				auto notes = bench_plugin(catalog, &host, {name, "notes", rate, block, v, p}, seconds);
+				notes.noteon_ns = (notes.ns_per_sample - held.ns_per_sample) * block / v;
+				results.push_back(notes);
+			}
+
+			for (size_t i = first; i < results.size() && !output.empty(); ++i)
+			{
+				printf("%s\n", to_json(results[i]).c_str());
+			}
+		}
+	}
+
+	if (chains)
+	{
+		if (synths.empty() || effects.empty())
+		{
+			printf("BENCH ERROR: the graph needs a synth and an effect\n");
+		}
+		else
+		{
+			for (auto block : blocks)
+			{
+				size_t first = results.size();
+
+				bench_graph(catalog, &host, chains, synths[0], effects[0], rates[0], block,
+					voices.empty() ? 1 : voices.back(), polyphonies.back(), seconds, results);
+
+				for (size_t i = first; i < results.size() && !output.empty(); ++i)
+				{
+					printf("%s\n", to_json(results[i]).c_str());
+				}
+			}
+		}
+	}
+
+	catalog.close();
+
+	std::ofstream file;
+	if (!output.empty())
+	{
+		file.open(output);
+		if (!file.is_open())
+		{
+			printf("BENCH ERROR: can't write %s\n", output.c_str());
+			return 1;
+		}
+	}
+
+	std::ostream &out = output.empty() ? std::cout : file;
+
+	out << "[\n";
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		out << to_json(results[i]) << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	out << "]\n";
+
+	if (!baseline.empty() && compare(results, base, threshold))
+	{
+		return 2;
+	}
+
+	return 0;
+}
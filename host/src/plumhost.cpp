@@ -20,11 +20,16 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
+#include <thread>
 #include <gtkmm.h>
 
 #include "plumhelpers.h"
 #include "plumhost.h"
+#include "tracer.h"
+#include "perfcounters.h"
 
 #include "glade.cpp"
 
@@ -56,46 +61,115 @@ std::string choose_file(Gtk::Window &window, std::string title, std::string exte
 	return "";
 }
 
-class tracklabel : public Gtk::Label
+// the plugins are owned by plumhost::m_plugins, the label only shows them.
+// the dsp load of the slot is on the right.
+
+class tracklabel : public Gtk::Box
 {
 	bool m_is_synth;
 	plum::iplugin *m_plugin {nullptr};
+	Gtk::Label m_name;
+	Gtk::Label m_load;
 
 public:
 	tracklabel(bool bsynth) : m_is_synth(bsynth)
 	{
-		set_label(m_is_synth ? "<no synth>" : "<no effect>");
+		m_name.set_label(m_is_synth ? "<no synth>" : "<no effect>");
+		m_name.set_halign(Gtk::Align::ALIGN_START);
+		m_load.set_width_chars(7);
+		m_load.set_xalign(1);
+
+		pack_start(m_name, true, true);
+		pack_end(m_load, false, false);
 	}
 
 	bool is_synth() { return m_is_synth; }
 
 	void set_plugin(plum::iplugin *plugin) 
 	{ 
-		if (m_plugin)
-		{
-			m_plugin->release();
-		}
-
 		m_plugin = plugin; 
 		if (m_plugin)
 		{
 			auto name = m_plugin->get_name();
-			set_label(name);
+			m_name.set_label(name);
 		}
 		else
 		{
-			set_label(m_is_synth ? "<no synth>" : "<no effect>");
+			m_name.set_label(m_is_synth ? "<no synth>" : "<no effect>");
 		}
 
+		set_load(nullptr, nullptr);
 	}
 	plum::iplugin *get_plugin() { return m_plugin; }
 
+	// the load since the previous snapshot, the worst call in the tooltip
+	void set_load(const nodeload *now, const nodeload *before)
+	{
+		if (now == nullptr || m_plugin == nullptr)
+		{
+			m_load.set_label("");
+			m_load.set_tooltip_text("");
+			return;
+		}
+
+		char str[64];
+		snprintf(str, 64, "%.1f%%", 100 * (before ? now->load_since(*before) : now->load()));
+		m_load.set_label(str);
+
+		char tip[200];
+		int n = snprintf(tip, 200, "mean %.1f us, max %.1f us", now->mean_ns() * 1e-3, now->max_ns * 1e-3);
+
+		if (now->counted_frames)
+		{
+			auto r = now->ratios();
+			n += snprintf(tip + n, 200 - n, "\nipc %.2f, %.2f cache and %.2f branch misses per 1000 instructions",
+				r.ipc, r.cache_mpki, r.branch_mpki);
+		}
+
+		if (now->dropped_events)
+		{
+			snprintf(tip + n, 200 - n, "\n%lu events dropped", (unsigned long)now->dropped_events);
+		}
+
+		m_load.set_tooltip_text(tip);
+	}
+
 };
 
 
 plumhost::plumhost() 
 {
-	m_audio.start("plum.host", &m_engine);
+	// PLUM_TRACE names a chrome trace file, see tracer.h
+	const char *trace = getenv("PLUM_TRACE");
+	if (trace && trace_start(trace))
+	{
+		trace_thread("gui");
+	}
+
+	// PLUM_PERF adds hardware counters to the load stats, where the kernel allows
+	if (getenv("PLUM_PERF"))
+	{
+		perf_start();
+	}
+
+	uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+	m_mixer.set_render_ahead(RENDER_AHEAD);
+	m_mixer.set_xrunlog(&m_xrunlog);
+	m_mixer.start(cores - 1);
+
+	// PLUM_BACKEND picks the audio backend, see backend.h
+	const char *spec = getenv("PLUM_BACKEND");
+	m_audio = create_backend(spec ? spec : "jack");
+	m_audio->set_xrunlog(&m_xrunlog);
+
+	if (m_audio->start("plum.host", &m_mixer) && m_audio->priority() > 0)
+	{
+		m_mixer.set_priority(m_audio->priority() - 1);
+	}
+
+	// for plumtop, PLUM_STATS renames the segment
+	const char *stats = getenv("PLUM_STATS");
+	m_stats.start(stats ? stats : STATS_NAME, &m_mixer, m_audio.get(), &m_xrunlog);
 
 	set_title(APP_TITLE);
 	set_default_size(920, 500);
@@ -119,6 +193,12 @@ plumhost::plumhost()
 	btn = Glib::RefPtr<Gtk::ToolButton>::cast_dynamic(ui->get_object("tbUnplug"));
 	btn->signal_clicked().connect(sigc::mem_fun(this, &plumhost::on_tbUnplug));
 
+	btn = Glib::RefPtr<Gtk::ToolButton>::cast_dynamic(ui->get_object("tbDump"));
+	btn->signal_clicked().connect(sigc::mem_fun(this, &plumhost::on_tbDump));
+
+	m_tracks = Glib::RefPtr<Gtk::ComboBoxText>::cast_dynamic(ui->get_object("cboTracks"));
+	m_load = Glib::RefPtr<Gtk::Label>::cast_dynamic(ui->get_object("lblLoad"));
+
 	m_track = Glib::RefPtr<Gtk::ListBox>::cast_dynamic(ui->get_object("track"));
 	m_track->signal_row_selected().connect(sigc::mem_fun(this, &plumhost::on_plugin_selected));
 
@@ -146,6 +226,8 @@ plumhost::plumhost()
 	init_treeview();
 	init_track();
 
+	m_load_timer = Glib::signal_timeout().connect(sigc::mem_fun(this, &plumhost::on_load_timer), 500);
+
 	show_all_children();
 }
 
@@ -163,15 +245,29 @@ void plumhost::init_treeview() // catalog
 
 void plumhost::init_track()
 {
-	auto n = m_engine.max_effects() + 1;
+	auto n = current_track().max_effects() + 1;
+
+	m_plugins.resize(m_mixer.count_tracks());
+	for (auto &slots : m_plugins)
+	{
+		slots.resize(n, nullptr);
+	}
+
+	for (uint32_t i = 0; i < m_mixer.count_tracks(); ++i)
+	{
+		m_tracks->append("Track " + std::to_string(i + 1));
+	}
+
+	m_tracks->set_active(m_current_track);
+	m_tracks->signal_changed().connect(sigc::mem_fun(this, &plumhost::on_track_selected));
+
 	for (uint32_t i = 0; i < n; ++i)
 	{
 		bool is_synth = i == 0;
 		auto l = new tracklabel(is_synth);
 		auto item = Gtk::manage(l);
-		item->set_halign(Gtk::Align::ALIGN_START) ;
 		m_track->append(*item);
-		item->show();
+		item->show_all();
 	}
 }
 
@@ -209,12 +305,48 @@ void plumhost::on_tbUnplug()
 	auto sel = m_track->get_selected_row();
 	if (sel)
 	{
-		unplug(sel);
+		unplug(m_current_track, sel->get_index());
 	}
 }
 
+// callback timing and the blocks before each xrun, for a post-mortem
+
+void plumhost::on_tbDump() 
+{
+	auto filename = choose_file(*this, "Dump Timing", "*.txt", true);
+
+	if (filename != "")
+	{
+		m_xrunlog.dump(filename);
+	}
+}
+
+void plumhost::on_track_selected()
+{
+	int n = m_tracks->get_active_row_number();
+	if (n == -1)
+	{
+		return;
+	}
+
+	closeview();
+	m_track->unselect_all();
+
+	m_current_track = n;
+	m_mixer.set_armed(n);
+	m_node_loads.clear();
+
+	display_track();
+}
+
 void plumhost::on_plugin_selected(Gtk::ListBoxRow* row)
 {
+	if (row == nullptr)
+	{
+		openview(nullptr);
+		return;
+	}
+
 	auto tl = (tracklabel *)row->get_child();
 	if (tl->get_plugin())
 	{
@@ -247,8 +379,12 @@ void plumhost::on_preset_selected()
 
 bool plumhost::on_exit(GdkEventAny* event) 
 {
-	m_audio.stop();
+	m_load_timer.disconnect();
+	m_stats.stop();
+	m_audio->stop();
+	m_mixer.stop();
 	close_library();
+	trace_stop();
 
 	return false;
 }
@@ -284,6 +420,7 @@ void plumhost::on_storage(bool save, bool bank)
 
 				if (filename.length() > 0)
 				{
+					tracescope trace("gui", bank ? "save bank" : "save preset");
 
 					std::ofstream file(filename, std::ios::binary);
 					if (file.is_open())
@@ -311,6 +448,8 @@ void plumhost::on_storage(bool save, bool bank)
 
 				if (filename.length() > 0)
 				{
+					tracescope trace("gui", bank ? "load bank" : "load preset");
+
 					std::ifstream file(filename, std::ios::binary);
 
 					if (file.is_open())
@@ -383,6 +522,51 @@ void plumhost::on_load_bank()
 	on_storage(false, true);
 }
 
+bool plumhost::on_load_timer()
+{
+	std::vector<float> loads;
+	m_mixer.track_loads(loads);
+
+	float total = 0;
+	for (auto l : loads)
+	{
+		total += l;
+	}
+
+	char str[64];
+	snprintf(str, 64, "DSP %3.1f%%  all %3.1f%%  %u cores  %lu xruns", 
+		100 * loads[m_current_track], 100 * total, m_mixer.count_workers(),
+		(unsigned long)m_xrunlog.count_xruns());
+	m_load->set_label(str);
+
+	// the load column of the track list
+
+	std::vector<nodeload> nodes;
+	m_mixer.node_loads(m_current_track, nodes);
+
+	std::map<uint32_t, nodeload> last;
+	last.swap(m_node_loads);
+
+	for (uint32_t i = 0; i < m_plugins[m_current_track].size(); ++i)
+	{
+		auto item = (tracklabel *)m_track->get_row_at_index(i)->get_child();
+		auto now = std::find_if(nodes.begin(), nodes.end(), 
+			[i](const nodeload &l) { return l.slot == int32_t(i); });
+
+		if (now == nodes.end())
+		{
+			item->set_load(nullptr, nullptr);
+			continue;
+		}
+
+		auto before = last.find(now->id);
+		item->set_load(&*now, before != last.end() ? &before->second : nullptr);
+		m_node_loads[now->id] = *now;
+	}
+
+	return true;
+}
+
 
 // ------------------------------------------------------------------------------------
 // IOBJECT
@@ -401,6 +585,10 @@ void *plumhost::as(const char *ifid)
 	{
 		reference(); return static_cast<plum::ihost *>(this);
 	}
+	else if (std::string(ifid) == IFID_PLUM_JOBS)
+	{
+		m_mixer.board()->reference(); return static_cast<plum::ijobs *>(m_mixer.board());
+	}
 
 	return nullptr;
 }
@@ -468,24 +656,29 @@ void plumhost::open_library(std::string filepath)
 	}
 }
 
-void plumhost::clear_track()
+void plumhost::clear_tracks()
 {
-	for (uint32_t index = 0; index < m_engine.max_effects() + 1; ++index)
+	for (uint32_t track = 0; track < m_plugins.size(); ++track)
 	{
-		auto row = m_track->get_row_at_index(index);
-		auto tl = (tracklabel *)row->get_child();
-
-		if (tl && tl->get_plugin())
-		{		
-			unplug(row);
+		for (uint32_t slot = 0; slot < m_plugins[track].size(); ++slot)
+		{
+			unplug(track, slot);
 		}
-	};
+	}
+}
+
+track_engine &plumhost::current_track()
+{
+	return m_mixer.track(m_current_track);
 }
 
 void plumhost::close_library()
 {
 	closeview();
-	clear_track();
+	clear_tracks();
+
+	// the plugin code goes away with the library
+	m_mixer.flush();
 
 	m_ts->clear();
 	m_catalog.close();
@@ -530,44 +723,83 @@ void plumhost::plug(std::string name, bool is_synth)
 		}
 		
 
-		plugin->configure(m_audio.samplerate(), m_audio.buffersize());
+		// a plugin that asks for a block size gets it through the host adapter
 
-		auto item = (tracklabel *)row->get_child();
-		item->set_plugin(plugin);
+		uint32_t blocksize = m_mixer.max_block();
+
+		auto b = (plum::iblocksize *)plugin->as(IFID_PLUM_BLOCKSIZE);
+		if (b)
+		{
+			blocksize = b->get_block_size();
+			b->release();
+		}
+
+		plugin->configure(m_audio->samplerate(), blocksize);
+
+		closeview();
 
 		if (is_synth)
 		{
-			m_engine.set_synth(plugin); 
+			current_track().set_synth(plugin); 
 		}
 		else
 		{
-			m_engine.set_effect(plugin, index - 1); 
+			current_track().set_effect(plugin, index - 1); 
+		}
+
+		m_mixer.edit([this] {m_audio->update_latency();});
+
+		auto &slot = m_plugins[m_current_track][index];
+		if (slot)
+		{
+			slot->release();
 		}
 
+		slot = plugin;
+
+		auto item = (tracklabel *)row->get_child();
+		item->set_plugin(plugin);
+
 		openview(row);
 	}
 }
 
-void plumhost::unplug(Gtk::ListBoxRow *row)
+void plumhost::unplug(uint32_t track, uint32_t slot)
 {
-	auto sel = m_track->get_selected_row();
-	if (row == sel)
+	auto &plugin = m_plugins[track][slot];
+	if (plugin == nullptr)
 	{
-		closeview();
+		return;
 	}
 
-	auto item = (tracklabel *)row->get_child();
+	if (track == m_current_track)
+	{
+		auto sel = m_track->get_selected_row();
+		if (sel && sel->get_index() == int(slot))
+		{
+			closeview();
+		}
+	}
 
-	if (item->is_synth())
+	if (slot == 0)
 	{
-		m_engine.set_synth(nullptr);
+		m_mixer.track(track).set_synth(nullptr);
 	}
 	else
 	{
-		m_engine.set_effect(nullptr, row->get_index() - 1);
+		m_mixer.track(track).set_effect(nullptr, slot - 1);
 	}
 
-	item->set_plugin(nullptr);
+	m_mixer.edit([this] {m_audio->update_latency();});
+
+	plugin->release();
+	plugin = nullptr;
+
+	if (track == m_current_track)
+	{
+		auto item = (tracklabel *)m_track->get_row_at_index(slot)->get_child();
+		item->set_plugin(nullptr);
+	}
 }
 
 void plumhost::openview(Gtk::ListBoxRow *row)
@@ -665,6 +897,17 @@ void plumhost::display_selected_preset()
 	}
 }
 
+void plumhost::display_track()
+{
+	auto &slots = m_plugins[m_current_track];
+
+	for (uint32_t i = 0; i < slots.size(); ++i)
+	{
+		auto item = (tracklabel *)m_track->get_row_at_index(i)->get_child();
+		item->set_plugin(slots[i]);
+	}
+}
+
 void plumhost::display_parameters()
 {
 	if (m_current_controller == controller_basic)
@@ -25,10 +25,14 @@
 #include "plugincatalog.h"
 #include "pluginview.h"
 #include "controller.h"
-#include "audio.h"
+#include "backend.h"
 #include "engine.h"
+#include "mixer.h"
+#include "statspublisher.h"
 
 #define APP_TITLE "Plum host 1.0"
+#define TRACK_COUNT 8
+#define RENDER_AHEAD 1024
 
 class ModelColumns : public Gtk::TreeModel::ColumnRecord
 {
@@ -47,8 +51,13 @@ class plumhost : public Gtk::Window, public plum::ihost
 	enum controller_type {controller_none, controller_basic, controller_custom};
 	controller_type m_current_controller {controller_none};
 
-	audio m_audio;
-	track_engine m_engine;
+	xrunlog m_xrunlog;
+	std::unique_ptr<backend> m_audio;
+	mixer m_mixer {TRACK_COUNT};
+	statspublisher m_stats;
+
+	uint32_t m_current_track {0};
+	std::vector<std::vector<plum::iplugin *>> m_plugins;
 
 	plugincatalog m_catalog;
 	pluginview m_pluginview;
@@ -58,6 +67,11 @@ class plumhost : public Gtk::Window, public plum::ihost
 	Glib::RefPtr<Gtk::TreeStore> m_ts;
 	ModelColumns m_columns;
 
+	Glib::RefPtr<Gtk::ComboBoxText> m_tracks;
+	Glib::RefPtr<Gtk::Label> m_load;
+	sigc::connection m_load_timer;
+	std::map<uint32_t, nodeload> m_node_loads;
+
 	Glib::RefPtr<Gtk::ListBox> m_track;
 	Glib::RefPtr<Gtk::ScrolledWindow> m_scroller;
 	Glib::RefPtr<Gtk::ComboBoxText> m_presets;	
@@ -70,6 +84,8 @@ class plumhost : public Gtk::Window, public plum::ihost
 	void on_tbLibrary();
 	void on_tbPlug();
 	void on_tbUnplug();
+	void on_tbDump();
+	void on_track_selected();
 	void on_plugin_selected(Gtk::ListBoxRow *);
 	void on_preset_selected();
 
@@ -78,6 +94,7 @@ class plumhost : public Gtk::Window, public plum::ihost
 	void on_save_bank();
 	void on_load_preset();
 	void on_load_bank();
+	bool on_load_timer();
 
 	void plugin_preset_selected(plum::iplugin *) override;
 	void plugin_bank_changed(plum::iplugin *) override;
@@ -92,8 +109,10 @@ class plumhost : public Gtk::Window, public plum::ihost
 	void open_library(std::string);
 	void close_library();
 	void plug(std::string name, bool is_synth);
-	void unplug(Gtk::ListBoxRow *);
-	void clear_track();
+	void unplug(uint32_t track, uint32_t slot);
+	void clear_tracks();
+
+	track_engine &current_track();
 
 	plum::iplugin *get_selected_plugin();
 
@@ -103,6 +122,7 @@ class plumhost : public Gtk::Window, public plum::ihost
 	void display_selected_preset();
 	void display_preset_list(plum::iplugin *);
 	void display_parameters();
+	void display_track();
 
 
 
@@ -0,0 +1,488 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+#include "plumhelpers.h"
+#include "plugincatalog.h"
+#include "headlesshost.h"
+#include "engine.h"
+#include "mixer.h"
+#include "backend.h"
+#include "tracer.h"
+#include "rtcheck.h"
+#include "smf.h"
+#include "wav.h"
+
+// offline renderer: a standard midi file through one track, into a wave file,
+// as fast as the cpu allows. no jack, no gtk. with -B the host mixer is
+// driven by the null or file backend instead, with its workers and threads.
+
+static void usage()
+{
+	printf(
+		"usage: plumrender -l library -s synth [options] input.mid\n"
+		"       plumrender -l library -s synth -B backend [options] [input.mid]\n"
+		"  -l file     plugin library\n"
+		"  -s name     synth\n"
+		"  -e name     effect, appended to the chain (repeatable)\n"
+		"  -p file     load a .plum.preset into the last plugin\n"
+		"  -b file     load a .plum.bank into the last plugin\n"
+		"  -P index    select a preset of the last plugin\n"
+		"  -o file     output wave file (default out.wav)\n"
+		"  -r rate     sample rate (default 48000)\n"
+		"  -n frames   block size (default 256)\n"
+		"  -t seconds  tail rendered after the last event (default 2)\n"
+		"  -c file     compare the loudness over time with a reference render\n"
+		"  -B spec     run the host mixer on a backend, \"null[,rate=..][,block=..]\" or\n"
+		"              \"file[,in=..][,out=..]\", see backend.h. the file backend takes\n"
+		"              input.mid and -o unless given, the null one runs for -d\n"
+		"  -d seconds  how long the null backend runs (default 10)\n");
+}
+
+
+static bool load_storage(plum::iplugin *plugin, const std::string &filename, bool bank)
+{
+	auto store = (plum::istorage *)plugin->as(IFID_PLUM_STORAGE);
+	if (store == nullptr)
+	{
+		printf("RENDER ERROR: %s has no storage\n", plugin->get_name());
+		return false;
+	}
+
+	std::ifstream file(filename, std::ios::binary);
+	bool ok = file.is_open();
+
+	if (ok)
+	{
+		std::vector<uint8_t> buffer(std::istreambuf_iterator<char>(file), {});
+		auto blob = new plum::blob(buffer.data(), buffer.size());
+		ok = bank ? store->set_bank_data(blob) : store->set_preset_data(blob);
+	}
+
+	if (!ok)
+	{
+		printf("RENDER ERROR: can't load %s\n", filename.c_str());
+	}
+
+	store->release();
+	return ok;
+}
+
+
+// streams the song through the engine block by block
+
+static bool render(track_engine &engine, smf &song, const std::string &output, 
+	uint32_t samplerate, uint32_t blocksize, double tail)
+{
+	wavwriter wav;
+	if (!wav.open(output, samplerate, 2))
+	{
+		return false;
+	}
+
+	auto events = song.events(samplerate);
+	uint64_t length = (events.empty() ? 0 : events.back().frame) + uint64_t(tail * samplerate);
+
+	std::vector<float> buffer(blocksize * 2);
+	float *outs[2] {buffer.data(), buffer.data() + blocksize};
+	std::vector<plum_event> block;
+
+	auto t0 = std::chrono::steady_clock::now();
+
+	size_t next = 0;
+	bool ok = true;
+
+	for (uint64_t frame = 0; frame < length && ok; frame += blocksize)
+	{
+		uint32_t nframes = std::min<uint64_t>(blocksize, length - frame);
+
+		block.clear();
+
+		for (; next < events.size() && events[next].frame < frame + nframes; ++next)
+		{
+			auto &e = events[next];
+			plum_event x {uint32_t(e.frame - frame), e.size, {}};
+			std::copy(e.data, e.data + 4, x.data);
+			block.push_back(x);
+		}
+
+		{
+			rtscope rt;
+			engine.process(nframes, block.data(), block.size(), nullptr, outs);
+		}
+
+		ok = wav.write(outs, nframes);
+	}
+
+	wav.close();
+
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	double seconds = double(length) / samplerate;
+
+	printf("%s: %.2f s rendered in %.3f s, realtime factor %.1fx\n", 
+		output.c_str(), seconds, wall, wall > 0 ? seconds / wall : 0);
+
+	return ok;
+}
+
+
+// two renders of the same song by different dsp code: the phases of the
+// oscillators need not match, so the level is compared over 10 ms windows
+
+static bool compare(const std::string &output, const std::string &reference)
+{
+	wavreader a, b;
+	if (!a.open(output) || !b.open(reference))
+	{
+		printf("RENDER ERROR: can't compare with %s\n", reference.c_str());
+		return false;
+	}
+
+	if (a.samplerate() != b.samplerate())
+	{
+		printf("RENDER ERROR: %s is at %u Hz, %s at %u Hz\n", 
+			output.c_str(), a.samplerate(), reference.c_str(), b.samplerate());
+		return false;
+	}
+
+	uint32_t window = std::max(1u, a.samplerate() / 100);
+	std::vector<float> buffer(window * 4);
+	float *ca[2] {buffer.data(), buffer.data() + window};
+	float *cb[2] {buffer.data() + 2 * window, buffer.data() + 3 * window};
+
+	double worst = 0, total = 0;
+	uint64_t loud = 0;
+
+	for (;;)
+	{
+		uint32_t na = a.read(ca, window);
+		uint32_t nb = b.read(cb, window);
+
+		if (na == 0 && nb == 0)
+		{
+			break;
+		}
+
+		double ea = 0, eb = 0;
+
+		for (uint32_t i = 0; i < window; ++i)
+		{
+			ea += ca[0][i] * ca[0][i] + ca[1][i] * ca[1][i];
+			eb += cb[0][i] * cb[0][i] + cb[1][i] * cb[1][i];
+		}
+
+		double la = 10 * log10(ea / (2 * window) + 1e-12);
+		double lb = 10 * log10(eb / (2 * window) + 1e-12);
+
+		// below -60 dB both are silence
+		if (std::max(la, lb) > -60)
+		{
+			double d = fabs(la - lb);
+			worst = std::max(worst, d);
+			total += d;
+			++loud;
+		}
+	}
+
+	printf("%s against %s: %lu windows of 10 ms, level difference mean %.2f dB, worst %.2f dB\n",
+		output.c_str(), reference.c_str(), (unsigned long)loud, loud ? total / loud : 0, worst);
+
+	return true;
+}
+
+
+// the mixer in real time, or as fast as the file backend goes: what plumhost
+// does without jack and gtk
+
+static bool run_backend(backend &b, mixer &m, double seconds)
+{
+	if (!b.start("plum.render", &m))
+	{
+		printf("RENDER ERROR: the backend did not start\n");
+		return false;
+	}
+
+	if (b.priority() > 0)
+	{
+		m.set_priority(b.priority() - 1);
+	}
+
+	auto t0 = std::chrono::steady_clock::now();
+
+	while (!b.finished())
+	{
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		if (seconds > 0 && elapsed >= seconds)
+		{
+			break;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+
+	b.stop();
+	return true;
+}
+
+
+// a plugin of the chain and the settings that follow it on the command line
+
+struct chainslot
+{
+	std::string name;
+	std::vector<std::pair<char, std::string>> settings;
+	plum::iplugin *plugin {nullptr};
+};
+
+static bool create(chainslot &slot, plugincatalog &catalog, plum::ihost *host, 
+	uint32_t samplerate, uint32_t blocksize)
+{
+	slot.plugin = catalog.create_plugin(slot.name, host);
+
+	if (slot.plugin == nullptr)
+	{
+		printf("RENDER ERROR: no plugin named %s\n", slot.name.c_str());
+		return false;
+	}
+
+	// as in plumhost: a plugin that asks for a block size gets it through the
+	// engine's adapter, and is configured for it
+
+	auto b = (plum::iblocksize *)slot.plugin->as(IFID_PLUM_BLOCKSIZE);
+	if (b)
+	{
+		blocksize = b->get_block_size();
+		b->release();
+	}
+
+	slot.plugin->configure(samplerate, blocksize);
+
+	for (auto &s : slot.settings)
+	{
+		switch (s.first)
+		{
+			case 'p': if (!load_storage(slot.plugin, s.second, false)) return false; break;
+			case 'b': if (!load_storage(slot.plugin, s.second, true)) return false; break;
+			case 'P': slot.plugin->set_selected_preset(std::stoul(s.second)); break;
+		}
+	}
+
+	return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+	std::string library, input, output = "out.wav", reference, spec;
+	uint32_t samplerate = 48000;
+	uint32_t blocksize = 256;
+	double tail = 2;
+	double duration = 10;
+
+	chainslot synth;
+	std::vector<chainslot> effects;
+	chainslot *last = nullptr;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+
+		if (arg.size() == 2 && arg[0] == '-' && i + 1 < argc)
+		{
+			std::string value = argv[++i];
+
+			switch (arg[1])
+			{
+				case 'l': library = value; break;
+				case 'o': output = value; break;
+				case 'r': samplerate = std::stoul(value); break;
+				case 'n': blocksize = std::stoul(value); break;
+				case 't': tail = std::stod(value); break;
+				case 'c': reference = value; break;
+				case 'B': spec = value; break;
+				case 'd': duration = std::stod(value); break;
+
+				case 's': 
+					synth.name = value;
+					last = &synth;
+					break;
+
+				case 'e': 
+					effects.push_back({value});
+					last = nullptr;
+					break;
+
+				case 'p': case 'b': case 'P':
+					if (last == nullptr && effects.empty())
+					{
+						usage();
+						return 1;
+					}
+
+					(last ? *last : effects.back()).settings.push_back({arg[1], value});
+					break;
+
+				default:
+					usage();
+					return 1;
+			}
+		}
+		else if (arg[0] != '-')
+		{
+			input = arg;
+		}
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+
+	if (library.empty() || synth.name.empty() || blocksize == 0 
+		|| (spec.empty() && input.empty()) || (!spec.empty() && !reference.empty()))
+	{
+		usage();
+		return 1;
+	}
+
+	smf song;
+	if (spec.empty() && !song.open(input))
+	{
+		return 1;
+	}
+
+	// the backend sets the rate and the block size
+
+	std::unique_ptr<backend> live;
+	bool file = spec.compare(0, 4, "file") == 0;
+
+	if (!spec.empty())
+	{
+		if (file && spec.find("in=") == std::string::npos && !input.empty()) spec += ",in=" + input;
+		if (file && spec.find("out=") == std::string::npos) spec += ",out=" + output;
+
+		live = create_backend(spec);
+		samplerate = live->samplerate();
+		blocksize = live->buffersize();
+	}
+
+	plugincatalog catalog;
+	if (!catalog.open(library))
+	{
+		return 1;
+	}
+
+	const char *trace = getenv("PLUM_TRACE");
+	if (trace && trace_start(trace))
+	{
+		trace_thread("render");
+	}
+
+	headlesshost host;
+	track_engine offline;
+	mixer m(1);
+	track_engine &engine = live ? m.track(0) : offline;
+	int code = 1;
+
+	if (live)
+	{
+		uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+		m.start(cores - 1);
+		host.set_jobs(m.board());
+		m.reset(blocksize, samplerate);
+	}
+	else
+	{
+		engine.reset(blocksize, samplerate);
+	}
+
+	if (effects.size() > engine.max_effects())
+	{
+		printf("RENDER ERROR: at most %u effects\n", engine.max_effects());
+	}
+	else if (create(synth, catalog, &host, samplerate, blocksize))
+	{
+		engine.set_synth(synth.plugin);
+
+		uint32_t index = 0;
+		bool ok = true;
+
+		for (auto &e : effects)
+		{
+			ok = ok && create(e, catalog, &host, samplerate, blocksize);
+			if (ok) engine.set_effect(e.plugin, index++);
+		}
+
+		if (ok && live)
+		{
+			m.flush();
+			code = run_backend(*live, m, file ? 0 : duration) ? 0 : 1;
+		}
+		else if (ok)
+		{
+			code = render(engine, song, output, samplerate, blocksize, tail) ? 0 : 1;
+
+			if (code == 0 && !reference.empty() && !compare(output, reference))
+			{
+				code = 1;
+			}
+		}
+	}
+
+	// the engine lets go of the plugins before the library is closed
+
+	engine.set_synth(nullptr);
+	for (uint32_t i = 0; i < effects.size(); ++i)
+	{
+		engine.set_effect(nullptr, i);
+	}
+
+	if (synth.plugin) synth.plugin->release();
+	for (auto &e : effects)
+	{
+		if (e.plugin) e.plugin->release();
+	}
+
+	m.flush();
+	m.stop();
+	host.set_jobs(nullptr);
+
+	catalog.close();
+	trace_stop();
+
+	// with PLUM_RTCHECK a render that made unsafe calls fails
+
+	if (rtcheck_report(stdout) && code == 0)
+	{
+		code = 3;
+	}
+
+	return code;
+}
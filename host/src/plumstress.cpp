@@ -0,0 +1,398 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <thread>
+
+#include "engine.h"
+#include "housekeeper.h"
+#include "mixer.h"
+
+// stress test of the track engine: one thread renders blocks on a period
+// like the audio callback while another plugs and unplugs dummy plugins as
+// fast as it can. a dummy released by the engine is never freed but marked
+// dead, so a retired item that still gets rendered is caught. programs are
+// freed for real: build with -fsanitize=address to check those too.
+//
+// -a instead arms the tracks of a mixer in turn while the others render
+// ahead, and checks that every note played on the armed track sounds at once.
+
+static void usage()
+{
+	printf(
+		"usage: plumstress [options]\n"
+		"  -e count     edits (default 5000)\n"
+		"  -n frames    block size (default 64)\n"
+		"  -r rate      sample rate (default 48000)\n"
+		"  -s           edit and reclaim on the editing thread, no housekeeper\n"
+		"  -a           arm test: switch the armed track of a mixer that renders ahead\n");
+}
+
+static uint64_t now_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+
+// ------------------------------------------------------------------------------------
+// DUMMY PLUGIN
+// ------------------------------------------------------------------------------------
+
+static std::atomic<uint64_t> s_stale {0};
+
+class dummy : public plum::iplugin
+{
+public:
+	void reference() override	{++m_rc;}
+	void release() override		{if (--m_rc == 0) m_dead = true;}
+
+	void *as(const char *ifid) override
+	{
+		if (std::string(ifid) == IFID_PLUM_OBJECT || std::string(ifid) == IFID_PLUM_PLUGIN)
+		{
+			reference(); return static_cast<plum::iplugin *>(this);
+		}
+
+		return nullptr;
+	}
+
+	const char *get_name() override											{return "dummy";}
+	plum::iwindow *open_ui(plum::ihostwindow *) override					{return nullptr;}
+
+	void configure(uint32_t samplerate, uint32_t buffer_size) override		{}
+	void activate() override												{}
+	void deactivate() override												{}
+
+	void midi_event(uint8_t *data) override
+	{
+		check();
+
+		uint8_t status = data[0] & 0xf0;
+		if (status == 0x90 && data[2]) ++m_notes;
+		else if (status == 0x80 || status == 0x90) --m_notes;
+	}
+
+	// the yield lets the editing thread run while the block is in the
+	// engine, even on a single core. a held note makes it loud.
+
+	void process(uint32_t nframes, float **ins, float **outs) override
+	{
+		check();
+		std::this_thread::yield();
+		check();
+
+		float level = m_notes > 0 ? 0.25f : 0.001f;
+
+		for (uint32_t i = 0; i < nframes; ++i)
+		{
+			outs[0][i] = level;
+			outs[1][i] = level;
+		}
+	}
+
+	plum::istring* get_preset_name(uint32_t index) override					{return nullptr;}
+	void set_preset_name(uint32_t index, plum::istring *) override			{}
+
+	uint32_t count_presets() override										{return 0;}
+	uint32_t get_selected_preset() override									{return 0;}
+	void set_selected_preset(uint32_t index) override						{}
+
+	uint32_t count_inputs() override										{return 2;}
+	plum::istring *get_input_name(uint32_t index) override					{return nullptr;}
+	uint32_t count_outputs() override										{return 2;}
+	plum::istring *get_output_name(uint32_t index) override					{return nullptr;}
+
+	uint32_t count_parameters() override									{return 0;}
+	float get_parameter(uint32_t index) override							{return 0;}
+	void set_parameter(uint32_t index, float value) override				{}
+	void get_parameter_def(uint32_t index, plum_param_def *details) override	{}
+
+	bool dead()
+	{
+		return m_dead;
+	}
+
+	int notes()
+	{
+		return m_notes;
+	}
+
+private:
+	void check()
+	{
+		if (m_dead)
+		{
+			++s_stale;
+		}
+	}
+
+	std::atomic<int> m_rc {1};
+	std::atomic<bool> m_dead {false};
+	std::atomic<int> m_notes {0};
+};
+
+
+// ------------------------------------------------------------------------------------
+// ARM TEST
+// ------------------------------------------------------------------------------------
+
+// two tracks, each armed in turn once the other rendered ahead for a while.
+// a note struck on the callback that arms a track must sound in that same
+// callback, or in the next one when the render-ahead thread was inside a
+// block of the track, and its note-off must arrive.
+
+static int arm_test(uint32_t block, uint32_t rate)
+{
+	const uint32_t ahead = 1024;
+	const int rounds = 40;
+
+	mixer m(2);
+	m.set_render_ahead(ahead);
+	m.start(0);
+	m.reset(block, rate);
+
+	dummy synths[2];
+	m.track(0).set_synth(&synths[0]);
+	m.track(1).set_synth(&synths[1]);
+	m.flush();
+
+	std::vector<float> buffer(2 * block);
+	float *outs[2] {buffer.data(), buffer.data() + block};
+
+	plum_event on {0, 3, {0x90, 60, 100, 0}};
+	plum_event off {0, 3, {0x80, 60, 0, 0}};
+
+	uint32_t late = 0, silent = 0;
+	timespec pause {0, long(uint64_t(block) * 1000000000ull / rate)};
+
+	for (int r = 0; r < rounds; ++r)
+	{
+		uint32_t armed = r % 2;
+
+		// the other track primes and renders ahead meanwhile
+		for (uint32_t k = 0; k < 2 * ahead / block; ++k)
+		{
+			m.process(block, nullptr, 0, nullptr, outs);
+			nanosleep(&pause, nullptr);
+		}
+
+		m.set_armed(armed);
+		m.process(block, &on, 1, nullptr, outs);
+
+		if (synths[armed].notes() != 1)
+		{
+			++late;
+			m.process(block, nullptr, 0, nullptr, outs);
+		}
+
+		if (synths[armed].notes() != 1 || outs[0][block - 1] < 0.2f)
+		{
+			++silent;
+		}
+
+		m.process(block, &off, 1, nullptr, outs);
+		m.process(block, nullptr, 0, nullptr, outs);
+	}
+
+	m.track(0).set_synth(nullptr);
+	m.track(1).set_synth(nullptr);
+	m.flush();
+	m.stop();
+
+	int stuck = synths[0].notes() + synths[1].notes();
+
+	printf("%d arms, %u a period late, %u silent, %d notes stuck\n", rounds, late, silent, stuck);
+
+	if (silent || stuck)
+	{
+		printf("STRESS ERROR: notes played on an armed track were lost\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+
+// ------------------------------------------------------------------------------------
+// MAIN
+// ------------------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+	uint32_t edits = 5000;
+	uint32_t block = 64;
+	uint32_t rate = 48000;
+	bool sync = false;
+	bool arm = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "-e" && i + 1 < argc) edits = std::stoul(argv[++i]);
+		else if (arg == "-n" && i + 1 < argc) block = std::stoul(argv[++i]);
+		else if (arg == "-r" && i + 1 < argc) rate = std::stoul(argv[++i]);
+		else if (arg == "-s") sync = true;
+		else if (arg == "-a") arm = true;
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+
+	if (block == 0 || rate == 0)
+	{
+		usage();
+		return 1;
+	}
+
+	if (arm)
+	{
+		return arm_test(block, rate);
+	}
+
+	housekeeper house;
+	track_engine engine;
+
+	if (!sync)
+	{
+		house.start();
+		engine.set_housekeeper(&house);
+	}
+
+	engine.reset(block, rate);
+
+	// the audio side: a block every period, late when it ends after the next one
+
+	std::atomic<bool> quit {false};
+	uint64_t blocks = 0, late = 0;
+
+	std::thread audio([&]
+	{
+		std::vector<float> buffer(2 * block);
+		float *outs[2] {buffer.data(), buffer.data() + block};
+		plum_event note {0, 3, {0x90, 60, 100, 0}};
+
+		uint64_t period = uint64_t(block) * 1000000000ull / rate;
+		uint64_t deadline = now_ns() + period;
+
+		while (!quit)
+		{
+			uint64_t t = now_ns();
+			if (t < deadline)
+			{
+				timespec ts {time_t((deadline - t) / 1000000000ull), long((deadline - t) % 1000000000ull)};
+				nanosleep(&ts, nullptr);
+			}
+
+			engine.process(block, &note, blocks % 16 == 0, nullptr, outs);
+
+			if (now_ns() > deadline + period)
+			{
+				++late;
+				deadline = now_ns();
+			}
+
+			deadline += period;
+			++blocks;
+		}
+	});
+
+	// the gui side: every edit replaces the synth or one of the effects
+
+	std::deque<dummy> plugins;
+	uint32_t slots = engine.max_effects() + 1;
+
+	for (uint32_t i = 0; i < edits; ++i)
+	{
+		plugins.emplace_back();
+		dummy *d = &plugins.back();
+		d->configure(rate, block);
+		d->activate();
+
+		uint32_t slot = i % slots;
+
+		if (slot == 0)
+		{
+			engine.set_synth(d);
+		}
+		else
+		{
+			engine.set_effect(i % 7 == 0 ? nullptr : d, slot - 1);
+		}
+
+		d->release();
+
+		if (i % 64 == 63)
+		{
+			house.flush();
+		}
+	}
+
+	house.flush();
+
+	engine.set_synth(nullptr);
+	for (uint32_t i = 0; i + 1 < slots; ++i)
+	{
+		engine.set_effect(nullptr, i);
+	}
+
+	house.flush();
+
+	quit = true;
+	audio.join();
+	house.stop();
+
+	// with every slot empty each dummy must have been released
+	uint64_t leaked = 0;
+	for (auto &d : plugins)
+	{
+		leaked += !d.dead();
+	}
+
+	printf("%u edits, %lu blocks, %lu late, %lu rendered after release, %lu not released\n",
+		edits, (unsigned long)blocks, (unsigned long)late, 
+		(unsigned long)s_stale.load(), (unsigned long)leaked);
+
+	if (s_stale)
+	{
+		printf("STRESS ERROR: retired plugins were rendered\n");
+		return 1;
+	}
+
+	if (leaked)
+	{
+		printf("STRESS ERROR: plugins were never released\n");
+		return 1;
+	}
+
+	return 0;
+}
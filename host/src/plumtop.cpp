@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+
+#include "statsshm.h"
+
+// live view of a running host, read from its stats segment. no gui, no jack.
+
+static void usage()
+{
+	printf(
+		"usage: plumtop [options]\n"
+		"  -n name     stats segment (default " STATS_NAME ")\n"
+		"  -i ms       refresh interval (default 500)\n"
+		"  -1          print once and exit\n");
+}
+
+static uint64_t now_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static void display(const statsdata &d)
+{
+	double age = (now_ns() - d.updated_ns) * 1e-9;
+
+	printf("plumhost %u   %u Hz   %u frames   %u workers%s\n", 
+		d.pid, d.samplerate, d.buffersize, d.workers, age > 2 ? "   (not updating)" : "");
+	printf("DSP %5.1f%%   xruns %lu   midi %.1f events/s\n\n", 
+		100 * d.load, (unsigned long)d.xruns, d.midi_rate);
+
+	printf("%-6s %-4s %-24s %8s %10s %7s", "track", "slot", "plugin", "dsp", "max", "voices");
+
+	if (d.counters)
+	{
+		printf(" %6s %8s %8s %9s", "ipc", "llc/ki", "br/ki", "cyc/frame");
+	}
+
+	printf("\n");
+
+	for (uint32_t t = 0; t < d.tracks && t < STATS_TRACKS; ++t)
+	{
+		auto &track = d.track[t];
+
+		if (track.slots == 0)
+		{
+			continue;
+		}
+
+		printf("%-6u %-4s %-24s %7.1f%%\n", t + 1, "", "", 100 * track.load);
+
+		for (uint32_t i = 0; i < track.slots && i < STATS_SLOTS; ++i)
+		{
+			auto &s = track.slot[i];
+
+			if (!s.used)
+			{
+				continue;
+			}
+
+			printf("%-6s %-4u %-24.24s %7.1f%% %8.1f us %7u", 
+				"", i, s.name, 100 * s.load, s.max_us, s.voices);
+
+			if (d.counters)
+			{
+				printf(" %6.2f %8.2f %8.2f %9.1f", s.ipc, s.cache_mpki, s.branch_mpki, s.cycles_per_frame);
+			}
+
+			printf("\n");
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	std::string name = STATS_NAME;
+	int interval = 500;
+	bool once = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "-n" && i + 1 < argc) name = argv[++i];
+		else if (arg == "-i" && i + 1 < argc) interval = std::stoi(argv[++i]);
+		else if (arg == "-1") once = true;
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+
+	statsshm shm;
+	if (!shm.open(name))
+	{
+		printf("PLUMTOP ERROR: no host publishes %s\n", name.c_str());
+		return 1;
+	}
+
+	statsdata d;
+
+	for (;;)
+	{
+		if (!shm.read(d))
+		{
+			printf("PLUMTOP ERROR: can't read a consistent copy\n");
+			return 1;
+		}
+
+		if (!once)
+		{
+			printf("\033[H\033[2J");
+		}
+
+		display(d);
+		fflush(stdout);
+
+		if (once)
+		{
+			return 0;
+		}
+
+		usleep(interval * 1000);
+	}
+}
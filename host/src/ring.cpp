@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+
+#include "ring.h"
+
+// the capacity is rounded up to a power of two
+
+void audioring::resize(uint32_t frames)
+{
+	uint32_t size = 1;
+	while (size < frames)
+	{
+		size <<= 1;
+	}
+
+	m_data[0].assign(size, 0);
+	m_data[1].assign(size, 0);
+	m_mask = size - 1;
+
+	clear();
+}
+
+void audioring::clear()
+{
+	m_read.store(0, std::memory_order_relaxed);
+	m_write.store(0, std::memory_order_relaxed);
+}
+
+uint32_t audioring::available()
+{
+	return m_write.load(std::memory_order_acquire) - m_read.load(std::memory_order_relaxed);
+}
+
+uint32_t audioring::space()
+{
+	return m_data[0].size() - (m_write.load(std::memory_order_relaxed) - m_read.load(std::memory_order_acquire));
+}
+
+void audioring::write(float **source, uint32_t nframes)
+{
+	uint64_t w = m_write.load(std::memory_order_relaxed);
+	uint32_t pos = w & m_mask;
+	uint32_t first = std::min<uint32_t>(nframes, m_data[0].size() - pos);
+
+	for (int c = 0; c < 2; ++c)
+	{
+		std::copy(source[c], source[c] + first, m_data[c].data() + pos);
+		std::copy(source[c] + first, source[c] + nframes, m_data[c].data());
+	}
+
+	m_write.store(w + nframes, std::memory_order_release);
+}
+
+void audioring::read(float **target, uint32_t nframes)
+{
+	uint64_t r = m_read.load(std::memory_order_relaxed);
+	uint32_t pos = r & m_mask;
+	uint32_t first = std::min<uint32_t>(nframes, m_data[0].size() - pos);
+
+	for (int c = 0; c < 2; ++c)
+	{
+		std::copy(m_data[c].data() + pos, m_data[c].data() + pos + first, target[c]);
+		std::copy(m_data[c].data(), m_data[c].data() + nframes - first, target[c] + first);
+	}
+
+	m_read.store(r + nframes, std::memory_order_release);
+}
+
+// reader side: drops what was written so far
+
+void audioring::skip()
+{
+	m_read.store(m_write.load(std::memory_order_acquire), std::memory_order_release);
+}
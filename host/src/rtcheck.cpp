@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "rtcheck.h"
+
+#define RTCHECK_RECORDS 64
+#define RTCHECK_FRAMES 24
+
+struct rtviolation
+{
+	const char *call;
+	pid_t thread;
+	int depth;
+	void *frames[RTCHECK_FRAMES];
+};
+
+static rtviolation s_records[RTCHECK_RECORDS];
+static std::atomic<uint32_t> s_count {0};
+static bool s_reported = false;
+
+// depth of rtscopes, and a guard against the checker reporting itself
+static thread_local int t_scope = 0;
+static thread_local bool t_busy = false;
+
+
+// dlsym may allocate while the real functions are looked up, those
+// allocations come from a static arena and are never freed
+
+static char s_arena[16384];
+static size_t s_arena_used = 0;
+static bool s_resolving = false;
+
+static bool in_arena(void *p)
+{
+	return p >= s_arena && p < s_arena + sizeof(s_arena);
+}
+
+static void *arena_alloc(size_t size)
+{
+	size = (size + 15) & ~size_t(15);
+
+	if (s_arena_used + size > sizeof(s_arena))
+	{
+		return nullptr;
+	}
+
+	void *p = s_arena + s_arena_used;
+	s_arena_used += size;
+	return p;
+}
+
+template <typename F>
+static F real(F &fn, const char *name)
+{
+	if (fn == nullptr)
+	{
+		s_resolving = true;
+		fn = (F)dlsym(RTLD_NEXT, name);
+		s_resolving = false;
+	}
+
+	return fn;
+}
+
+static void violation(const char *call)
+{
+	if (t_scope == 0 || t_busy)
+	{
+		return;
+	}
+
+	t_busy = true;
+
+	uint32_t n = s_count.fetch_add(1, std::memory_order_relaxed);
+
+	if (n < RTCHECK_RECORDS)
+	{
+		auto &r = s_records[n];
+		r.call = call;
+		r.thread = gettid();
+		r.depth = backtrace(r.frames, RTCHECK_FRAMES);
+	}
+
+	t_busy = false;
+}
+
+void rtcheck_enter()
+{
+	++t_scope;
+}
+
+void rtcheck_leave()
+{
+	--t_scope;
+}
+
+// backtrace_symbols_fd does not allocate, the report can run anywhere
+
+unsigned long rtcheck_report(FILE *f)
+{
+	uint32_t count = s_count.load();
+	uint32_t kept = std::min<uint32_t>(count, RTCHECK_RECORDS);
+
+	fprintf(f, "RTCHECK: %u calls that are not realtime safe\n", count);
+
+	for (uint32_t i = 0; i < kept; ++i)
+	{
+		auto &r = s_records[i];
+		fprintf(f, "\n%s on thread %d\n", r.call, r.thread);
+		fflush(f);
+
+		// the first frames are the checker itself
+		backtrace_symbols_fd(r.frames + 2, std::max(0, r.depth - 2), fileno(f));
+	}
+
+	fflush(f);
+	s_reported = true;
+	return count;
+}
+
+// the first backtrace() loads libgcc, which allocates: done before any scope
+
+__attribute__((constructor)) static void rtcheck_init()
+{
+	void *frames[2];
+	backtrace(frames, 2);
+
+	atexit([] 
+	{
+		if (s_count.load() && !s_reported)
+		{
+			rtcheck_report(stderr);
+		}
+	});
+}
+
+
+// ------------------------------------------------------------------------------------
+// INTERPOSED
+// ------------------------------------------------------------------------------------
+
+extern "C" {
+
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+
+static int (*real_pthread_mutex_lock)(pthread_mutex_t *);
+static int (*real_pthread_join)(pthread_t, void **);
+
+static int (*real_nanosleep)(const struct timespec *, struct timespec *);
+static int (*real_usleep)(useconds_t);
+static unsigned (*real_sleep)(unsigned);
+
+static int (*real_open)(const char *, int, ...);
+static int (*real_close)(int);
+static ssize_t (*real_read)(int, void *, size_t);
+static ssize_t (*real_write)(int, const void *, size_t);
+static FILE *(*real_fopen)(const char *, const char *);
+
+static void *(*real_mmap)(void *, size_t, int, int, int, off_t);
+static int (*real_munmap)(void *, size_t);
+
+
+void *malloc(size_t size)
+{
+	if (s_resolving)
+	{
+		return arena_alloc(size);
+	}
+
+	violation("malloc");
+	return real(real_malloc, "malloc")(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	if (s_resolving)
+	{
+		return arena_alloc(n * size);		// static, already zero
+	}
+
+	violation("calloc");
+	return real(real_calloc, "calloc")(n, size);
+}
+
+// the arena keeps no sizes, an arena block is copied up to the end of the
+// arena. a heap block grown while resolving moves to the arena and leaks.
+
+void *realloc(void *p, size_t size)
+{
+	if (s_resolving || in_arena(p))
+	{
+		size_t old = 0;
+		if (p)
+		{
+			old = in_arena(p) ? s_arena + sizeof(s_arena) - (char *)p : malloc_usable_size(p);
+		}
+
+		void *q = s_resolving ? arena_alloc(size) : malloc(size);
+		if (q && p)
+		{
+			memcpy(q, p, std::min(size, old));
+		}
+
+		return q;
+	}
+
+	violation("realloc");
+	return real(real_realloc, "realloc")(p, size);
+}
+
+void free(void *p)
+{
+	if (p == nullptr || in_arena(p))
+	{
+		return;
+	}
+
+	violation("free");
+	real(real_free, "free")(p);
+}
+
+int posix_memalign(void **p, size_t alignment, size_t size)
+{
+	violation("posix_memalign");
+	return real(real_posix_memalign, "posix_memalign")(p, alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	violation("aligned_alloc");
+	return real(real_aligned_alloc, "aligned_alloc")(alignment, size);
+}
+
+// trylock is fine on the audio thread. pthread_cond_wait is not interposed,
+// glibc exports two versions of it. it needs a locked mutex anyway.
+
+int pthread_mutex_lock(pthread_mutex_t *m)
+{
+	violation("pthread_mutex_lock");
+	return real(real_pthread_mutex_lock, "pthread_mutex_lock")(m);
+}
+
+int pthread_join(pthread_t t, void **result)
+{
+	violation("pthread_join");
+	return real(real_pthread_join, "pthread_join")(t, result);
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem)
+{
+	violation("nanosleep");
+	return real(real_nanosleep, "nanosleep")(req, rem);
+}
+
+int usleep(useconds_t us)
+{
+	violation("usleep");
+	return real(real_usleep, "usleep")(us);
+}
+
+unsigned sleep(unsigned s)
+{
+	violation("sleep");
+	return real(real_sleep, "sleep")(s);
+}
+
+int open(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+
+	if (flags & (O_CREAT | O_TMPFILE))
+	{
+		va_list args;
+		va_start(args, flags);
+		mode = va_arg(args, mode_t);
+		va_end(args);
+	}
+
+	violation("open");
+	return real(real_open, "open")(path, flags, mode);
+}
+
+int close(int fd)
+{
+	violation("close");
+	return real(real_close, "close")(fd);
+}
+
+ssize_t read(int fd, void *buffer, size_t size)
+{
+	violation("read");
+	return real(real_read, "read")(fd, buffer, size);
+}
+
+ssize_t write(int fd, const void *buffer, size_t size)
+{
+	violation("write");
+	return real(real_write, "write")(fd, buffer, size);
+}
+
+FILE *fopen(const char *path, const char *mode)
+{
+	violation("fopen");
+	return real(real_fopen, "fopen")(path, mode);
+}
+
+void *mmap(void *addr, size_t size, int prot, int flags, int fd, off_t offset)
+{
+	violation("mmap");
+	return real(real_mmap, "mmap")(addr, size, prot, flags, fd, offset);
+}
+
+int munmap(void *addr, size_t size)
+{
+	violation("munmap");
+	return real(real_munmap, "munmap")(addr, size);
+}
+
+}
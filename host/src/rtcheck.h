@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+// realtime-safety checker, built with the PLUM_RTCHECK cmake option. it 
+// interposes malloc and free, mutex locks, sleeps and file i/o, and records
+// every call made by a thread inside an rtscope: the backend callbacks, the
+// workers and the render-ahead thread while they render. reports come later
+// from rtcheck_report(), the audio thread only fills a preallocated buffer.
+// without the option the scope is empty.
+
+#ifdef PLUM_RTCHECK
+
+void rtcheck_enter();
+void rtcheck_leave();
+
+// prints what was recorded, returns the number of violations
+unsigned long rtcheck_report(FILE *f);
+
+struct rtscope
+{
+	rtscope() { rtcheck_enter(); }
+	~rtscope() { rtcheck_leave(); }
+};
+
+#else
+
+struct rtscope
+{
+	rtscope() {}
+};
+
+inline unsigned long rtcheck_report(FILE *) { return 0; }
+
+#endif
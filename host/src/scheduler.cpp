@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <time.h>
+
+#include "scheduler.h"
+
+static uint64_t now_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+
+// ------------------------------------------------------------------------------------
+// DEQUE
+// ------------------------------------------------------------------------------------
+
+bool taskdeque::push(graphstep *step)
+{
+	int64_t b = m_bottom.load(std::memory_order_relaxed);
+	int64_t t = m_top.load(std::memory_order_acquire);
+
+	if (b - t >= capacity)
+	{
+		return false;
+	}
+
+	m_items[b & (capacity - 1)].store(step, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	m_bottom.store(b + 1, std::memory_order_relaxed);
+	return true;
+}
+
+graphstep *taskdeque::pop()
+{
+	int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+	m_bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = m_top.load(std::memory_order_relaxed);
+
+	if (t > b)
+	{
+		m_bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	graphstep *step = m_items[b & (capacity - 1)].load(std::memory_order_relaxed);
+
+	if (t == b)
+	{
+		if (!m_top.compare_exchange_strong(t, t + 1, 
+			std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			step = nullptr;
+		}
+
+		m_bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	return step;
+}
+
+graphstep *taskdeque::steal()
+{
+	int64_t t = m_top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t b = m_bottom.load(std::memory_order_acquire);
+
+	if (t >= b)
+	{
+		return nullptr;
+	}
+
+	graphstep *step = m_items[t & (capacity - 1)].load(std::memory_order_relaxed);
+
+	if (!m_top.compare_exchange_strong(t, t + 1, 
+		std::memory_order_seq_cst, std::memory_order_relaxed))
+	{
+		return nullptr;
+	}
+
+	return step;
+}
+
+
+// ------------------------------------------------------------------------------------
+// SCHEDULER
+// ------------------------------------------------------------------------------------
+
+void scheduler::resize(uint32_t workers)
+{
+	m_deques.clear();
+
+	for (uint32_t i = 0; i < workers; ++i)
+	{
+		m_deques.emplace_back(new taskdeque);
+	}
+}
+
+void scheduler::set_jobs(jobboard *jobs)
+{
+	m_jobs = jobs;
+}
+
+void scheduler::run_serial(schedjob *jobs, uint32_t count, uint32_t nframes)
+{
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint64_t t0 = now_ns();
+		jobs[i].program->process(nframes, jobs[i].events, jobs[i].count, jobs[i].outs);
+
+		if (jobs[i].busy)
+		{
+			jobs[i].busy->fetch_add(now_ns() - t0, std::memory_order_relaxed);
+		}
+	}
+}
+
+void scheduler::run(workerpool &pool, schedjob *jobs, uint32_t count, uint32_t nframes)
+{
+	if (m_deques.size() < 2)
+	{
+		run_serial(jobs, count, nframes);
+		return;
+	}
+
+	m_nframes = nframes;
+
+	uint32_t active = 0;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		auto p = jobs[i].program;
+		p->m_target = jobs[i].outs;
+		p->m_busy = jobs[i].busy;
+		p->m_events = jobs[i].events;
+		p->m_count = jobs[i].count;
+		p->bind(p->m_target);
+
+		if (p->m_steps.empty())
+		{
+			p->output(nframes, p->m_target);
+			continue;
+		}
+
+		for (size_t k = 0; k < p->m_steps.size(); ++k)
+		{
+			p->m_pending[k].store(p->m_steps[k].predecessors, std::memory_order_relaxed);
+		}
+
+		p->m_remaining.store(p->m_steps.size(), std::memory_order_relaxed);
+		++active;
+	}
+
+	if (active == 0)
+	{
+		return;
+	}
+
+	m_remaining.store(active, std::memory_order_relaxed);
+
+	// the workers are asleep, so the caller can seed every deque
+
+	uint32_t d = 0;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		auto p = jobs[i].program;
+
+		for (auto r : p->m_roots)
+		{
+			if (!m_deques[d]->push(&p->m_steps[r]))
+			{
+				execute(0, &p->m_steps[r]);
+			}
+
+			d = (d + 1) % m_deques.size();
+		}
+	}
+
+	pool.run(work, this);
+}
+
+void scheduler::work(void *arg, uint32_t worker)
+{
+	auto _this = static_cast<scheduler *>(arg);
+
+	if (worker >= _this->m_deques.size())
+	{
+		return;
+	}
+
+	auto jobs = _this->m_jobs;
+	jobboard::join(jobs != nullptr);
+
+	while (_this->m_remaining.load(std::memory_order_acquire) > 0)
+	{
+		auto step = _this->next(worker);
+
+		if (step)
+		{
+			_this->execute(worker, step);
+		}
+		else if (!jobs || !jobs->help())
+		{
+			cpu_relax();
+		}
+	}
+
+	jobboard::join(false);
+}
+
+graphstep *scheduler::next(uint32_t worker)
+{
+	auto step = m_deques[worker]->pop();
+	if (step)
+	{
+		return step;
+	}
+
+	uint32_t n = m_deques.size();
+
+	for (uint32_t k = 1; k < n; ++k)
+	{
+		step = m_deques[(worker + k) % n]->steal();
+		if (step)
+		{
+			return step;
+		}
+	}
+
+	return nullptr;
+}
+
+void scheduler::execute(uint32_t worker, graphstep *step)
+{
+	auto p = step->program;
+
+	uint64_t t0 = now_ns();
+	p->run_step(m_nframes, *step);
+
+	if (p->m_busy)
+	{
+		p->m_busy->fetch_add(now_ns() - t0, std::memory_order_relaxed);
+	}
+
+	for (auto k : step->successors)
+	{
+		if (p->m_pending[k].fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			auto ready = &p->m_steps[k];
+
+			if (!m_deques[worker]->push(ready))
+			{
+				execute(worker, ready);
+			}
+		}
+	}
+
+	if (p->m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		p->output(m_nframes, p->m_target);
+		m_remaining.fetch_sub(1, std::memory_order_release);
+	}
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "graph.h"
+#include "workers.h"
+#include "jobboard.h"
+
+struct schedjob
+{
+	graphprogram *program;
+	float **outs;
+	std::atomic<uint64_t> *busy;
+	const plum_event *events;
+	uint32_t count;
+};
+
+
+// fixed size Chase-Lev deque: the owner pushes and pops at the bottom,
+// the other workers steal from the top
+
+class taskdeque
+{
+public:
+	static const int64_t capacity = 4096;
+
+	bool push(graphstep *step);
+	graphstep *pop();
+	graphstep *steal();
+
+private:
+	alignas(64) std::atomic<int64_t> m_top {0};
+	alignas(64) std::atomic<int64_t> m_bottom {0};
+	std::atomic<graphstep *> m_items[capacity];
+};
+
+
+// runs the steps of several programs on a workerpool. a step becomes
+// ready when all the steps feeding it are done, idle workers steal ready
+// steps from the others. the hot path doesn't allocate or lock.
+
+class scheduler
+{
+public:
+	void resize(uint32_t workers);
+
+	// the workers out of steps help with the jobs plugins post here
+	void set_jobs(jobboard *jobs);
+
+	void run(workerpool &pool, schedjob *jobs, uint32_t count, uint32_t nframes);
+	void run_serial(schedjob *jobs, uint32_t count, uint32_t nframes);
+
+private:
+	static void work(void *arg, uint32_t worker);
+	graphstep *next(uint32_t worker);
+	void execute(uint32_t worker, graphstep *step);
+
+	std::vector<std::unique_ptr<taskdeque>> m_deques;
+	std::atomic<uint32_t> m_remaining {0};
+	uint32_t m_nframes {0};
+	jobboard *m_jobs {nullptr};
+};
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#include "smf.h"
+
+static uint32_t read_be(const uint8_t *p, int n)
+{
+	uint32_t v = 0;
+
+	for (int i = 0; i < n; ++i)
+	{
+		v = (v << 8) | p[i];
+	}
+
+	return v;
+}
+
+// variable length quantity, false past the end
+static bool read_vlq(const uint8_t *&p, const uint8_t *end, uint32_t &v)
+{
+	v = 0;
+
+	for (int i = 0; i < 4; ++i)
+	{
+		if (p >= end)
+		{
+			return false;
+		}
+
+		uint8_t b = *p++;
+		v = (v << 7) | (b & 0x7F);
+
+		if ((b & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+bool smf::open(const std::string &path)
+{
+	std::ifstream file(path, std::ios::binary);
+
+	if (!file.is_open())
+	{
+		printf("SMF ERROR: can't open %s\n", path.c_str());
+		return false;
+	}
+
+	std::vector<uint8_t> buffer(std::istreambuf_iterator<char>(file), {});
+	const uint8_t *p = buffer.data();
+	const uint8_t *end = p + buffer.size();
+
+	if (buffer.size() < 14 || std::string((char *)p, 4) != "MThd")
+	{
+		printf("SMF ERROR: %s is not a midi file\n", path.c_str());
+		return false;
+	}
+
+	uint32_t length = read_be(p + 4, 4);
+	uint32_t format = read_be(p + 8, 2);
+	m_division = read_be(p + 12, 2);
+
+	if (format > 1)
+	{
+		printf("SMF ERROR: format %u is not supported\n", format);
+		return false;
+	}
+
+	m_events.clear();
+	m_tempo.clear();
+
+	p += 8 + length;
+
+	while (p + 8 <= end)
+	{
+		length = read_be(p + 4, 4);
+		const uint8_t *chunk = p + 8;
+
+		if (chunk + length > end)
+		{
+			printf("SMF ERROR: truncated chunk\n");
+			return false;
+		}
+
+		if (std::string((char *)p, 4) == "MTrk" && !read_track(chunk, chunk + length))
+		{
+			printf("SMF ERROR: bad track\n");
+			return false;
+		}
+
+		p = chunk + length;
+	}
+
+	// stable: events on the same tick keep the order of the file
+
+	std::stable_sort(m_events.begin(), m_events.end(), 
+		[](const tickevent &a, const tickevent &b) {return a.tick < b.tick;});
+
+	std::stable_sort(m_tempo.begin(), m_tempo.end(), 
+		[](const tempo &a, const tempo &b) {return a.tick < b.tick;});
+
+	return true;
+}
+
+bool smf::read_track(const uint8_t *p, const uint8_t *end)
+{
+	uint64_t tick = 0;
+	uint8_t status = 0;
+
+	while (p < end)
+	{
+		uint32_t delta;
+		if (!read_vlq(p, end, delta) || p >= end)
+		{
+			return false;
+		}
+
+		tick += delta;
+
+		if (*p & 0x80)
+		{
+			status = *p++;
+		}
+
+		if (status == 0xFF)
+		{
+			// meta event
+			if (p >= end) return false;
+
+			uint8_t type = *p++;
+			uint32_t length;
+
+			if (!read_vlq(p, end, length) || p + length > end)
+			{
+				return false;
+			}
+
+			if (type == 0x51 && length == 3)
+			{
+				m_tempo.push_back({tick, read_be(p, 3)});
+			}
+			else if (type == 0x2F)
+			{
+				return true;
+			}
+
+			p += length;
+			status = 0;
+		}
+		else if (status == 0xF0 || status == 0xF7)
+		{
+			// sysex, skipped
+			uint32_t length;
+
+			if (!read_vlq(p, end, length) || p + length > end)
+			{
+				return false;
+			}
+
+			p += length;
+			status = 0;
+		}
+		else if (status >= 0x80)
+		{
+			uint32_t size = (status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0 ? 2 : 3;
+
+			if (p + size - 1 > end)
+			{
+				return false;
+			}
+
+			tickevent e {tick, size, {status, 0, 0, 0}};
+			std::copy(p, p + size - 1, e.data + 1);
+			m_events.push_back(e);
+
+			p += size - 1;
+		}
+		else
+		{
+			// data byte without a running status
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::vector<smfevent> smf::events(uint32_t samplerate)
+{
+	std::vector<smfevent> result;
+	result.reserve(m_events.size());
+
+	// seconds per tick: smpte divisions are fixed, metrical ones follow the tempo
+
+	bool smpte = m_division & 0x8000;
+	double fixed = 0;
+
+	if (smpte)
+	{
+		int fps = -int8_t(m_division >> 8);
+		int ticks = m_division & 0xFF;
+		fixed = 1.0 / (fps * ticks);
+	}
+
+	uint32_t ppq = smpte ? 1 : std::max(1, m_division & 0x7FFF);
+	uint32_t usec = 500000;
+	uint64_t last = 0;
+	double seconds = 0;
+	size_t t = 0;
+
+	for (auto &e : m_events)
+	{
+		while (!smpte && t < m_tempo.size() && m_tempo[t].tick <= e.tick)
+		{
+			seconds += (m_tempo[t].tick - last) * usec / (1e6 * ppq);
+			last = m_tempo[t].tick;
+			usec = m_tempo[t].usec;
+			++t;
+		}
+
+		double s = smpte ? e.tick * fixed : seconds + (e.tick - last) * usec / (1e6 * ppq);
+
+		smfevent x {uint64_t(s * samplerate + 0.5), e.size, {}};
+		std::copy(e.data, e.data + 4, x.data);
+		result.push_back(x);
+	}
+
+	return result;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// a channel message of a standard midi file, at its sample position
+struct smfevent
+{
+	uint64_t frame;
+	uint32_t size;
+	uint8_t data[4];
+};
+
+// standard midi file reader, formats 0 and 1. the tempo map is applied
+// when the events are placed on the sample grid.
+
+class smf
+{
+public:
+	bool open(const std::string &path);
+
+	std::vector<smfevent> events(uint32_t samplerate);
+
+private:
+	struct tickevent
+	{
+		uint64_t tick;
+		uint32_t size;
+		uint8_t data[4];
+	};
+
+	struct tempo
+	{
+		uint64_t tick;
+		uint32_t usec;		// per quarter note
+	};
+
+	bool read_track(const uint8_t *p, const uint8_t *end);
+
+	uint16_t m_division {0};
+	std::vector<tickevent> m_events;
+	std::vector<tempo> m_tempo;
+};
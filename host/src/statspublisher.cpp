@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "statspublisher.h"
+
+static const int publish_ms = 500;
+
+static uint64_t now_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+statspublisher::~statspublisher()
+{
+	stop();
+}
+
+bool statspublisher::start(const std::string &name, mixer *m, backend *b, xrunlog *log)
+{
+	stop();
+
+	if (!m_shm.create(name))
+	{
+		return false;
+	}
+
+	m_mixer = m;
+	m_backend = b;
+	m_xrunlog = log;
+
+	m_last.clear();
+	m_last_midi = m_mixer->count_midi_events();
+	m_last_ns = now_ns();
+
+	m_quit = false;
+	m_thread = std::thread(&statspublisher::loop, this);
+	return true;
+}
+
+void statspublisher::stop()
+{
+	if (m_thread.joinable())
+	{
+		m_quit = true;
+		m_thread.join();
+	}
+
+	m_shm.close();
+}
+
+void statspublisher::loop()
+{
+	statsdata d;
+
+	while (!m_quit)
+	{
+		for (int i = 0; i < publish_ms / 50 && !m_quit; ++i)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		}
+
+		collect(d);
+		m_shm.write(d);
+	}
+}
+
+static void fill(statsslot &s, const nodeload &n, const nodeload *before)
+{
+	strncpy(s.name, n.name.c_str(), sizeof(s.name) - 1);
+	s.load = before ? n.load_since(*before) : 0;
+	s.max_us = n.max_ns * 1e-3f;
+	s.voices = n.voices;
+	s.used = 1;
+
+	if (before)
+	{
+		auto r = n.ratios_since(*before);
+		s.ipc = r.ipc;
+		s.cache_mpki = r.cache_mpki;
+		s.branch_mpki = r.branch_mpki;
+		s.cycles_per_frame = r.cycles_per_frame;
+	}
+}
+
+// the slots of the preset topology keep their position, other nodes fill the gaps
+
+void statspublisher::collect(statsdata &d)
+{
+	memset(&d, 0, sizeof(d));
+
+	uint64_t now = now_ns();
+	uint64_t midi = m_mixer->count_midi_events();
+
+	d.pid = getpid();
+	d.samplerate = m_backend->samplerate();
+	d.buffersize = m_backend->buffersize();
+	d.workers = m_mixer->count_workers();
+	d.updated_ns = now;
+	d.xruns = m_xrunlog ? m_xrunlog->count_xruns() : 0;
+	d.midi_rate = now > m_last_ns ? (midi - m_last_midi) * 1e9 / (now - m_last_ns) : 0;
+	d.counters = perf_enabled();
+	d.tracks = std::min<uint32_t>(m_mixer->count_tracks(), STATS_TRACKS);
+
+	m_last_midi = midi;
+	m_last_ns = now;
+
+	std::map<uint64_t, nodeload> last;
+	last.swap(m_last);
+
+	std::vector<nodeload> nodes;
+
+	for (uint32_t t = 0; t < d.tracks; ++t)
+	{
+		auto &track = d.track[t];
+		m_mixer->node_loads(t, nodes);
+
+		std::vector<const nodeload *> others;
+
+		for (auto &n : nodes)
+		{
+			uint64_t key = (uint64_t(t) << 32) | n.id;
+			auto before = last.find(key);
+			float load = before != last.end() ? n.load_since(before->second) : 0;
+
+			m_last[key] = n;
+			track.load += load;
+
+			if (n.slot >= 0 && n.slot < STATS_SLOTS && !track.slot[n.slot].used)
+			{
+				fill(track.slot[n.slot], n, before != last.end() ? &before->second : nullptr);
+				track.slots = std::max<uint32_t>(track.slots, n.slot + 1);
+			}
+			else
+			{
+				others.push_back(&n);
+			}
+		}
+
+		uint32_t free = 0;
+
+		for (auto n : others)
+		{
+			while (free < STATS_SLOTS && track.slot[free].used) ++free;
+			if (free == STATS_SLOTS) break;
+
+			auto before = last.find((uint64_t(t) << 32) | n->id);
+			fill(track.slot[free], *n, before != last.end() ? &before->second : nullptr);
+			track.slots = std::max<uint32_t>(track.slots, free + 1);
+		}
+
+		d.load += track.load;
+	}
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "statsshm.h"
+#include "mixer.h"
+#include "backend.h"
+#include "xrunlog.h"
+
+// copies the engine state into the stats segment twice a second, from its
+// own thread. the audio thread only bumps counters, it never waits for this.
+
+class statspublisher
+{
+public:
+	~statspublisher();
+
+	bool start(const std::string &name, mixer *m, backend *b, xrunlog *log);
+	void stop();
+
+private:
+	void loop();
+	void collect(statsdata &d);
+
+	statsshm m_shm;
+	mixer *m_mixer {nullptr};
+	backend *m_backend {nullptr};
+	xrunlog *m_xrunlog {nullptr};
+
+	std::thread m_thread;
+	std::atomic<bool> m_quit {false};
+
+	// counters of the previous update, nodes by track and id
+	std::map<uint64_t, nodeload> m_last;
+	uint64_t m_last_midi {0};
+	uint64_t m_last_ns {0};
+};
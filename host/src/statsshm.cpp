@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <new>
+
+#include "statsshm.h"
+
+statsshm::~statsshm()
+{
+	close();
+}
+
+// a segment left by a host that died, its writer pid is gone
+
+static bool abandoned(const std::string &name)
+{
+	statsshm old;
+	statsdata d;
+
+	if (!old.open(name) || !old.read(d) || d.pid == 0)
+	{
+		return false;
+	}
+
+	return kill(d.pid, 0) < 0 && errno == ESRCH;
+}
+
+// never maps a segment another host still writes: a name in use gets the pid
+// appended, plumtop -n finds it there
+
+bool statsshm::create(const std::string &name)
+{
+	close();
+
+	std::string target = name;
+	int fd = shm_open(target.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+
+	if (fd < 0 && errno == EEXIST && abandoned(target))
+	{
+		shm_unlink(target.c_str());
+		fd = shm_open(target.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	}
+
+	if (fd < 0 && errno == EEXIST)
+	{
+		target = name + "." + std::to_string(getpid());
+		fd = shm_open(target.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+
+		if (fd >= 0)
+		{
+			printf("STATS: %s is in use, publishing in %s\n", name.c_str(), target.c_str());
+		}
+	}
+
+	if (fd < 0)
+	{
+		printf("STATS ERROR: can't create %s\n", target.c_str());
+		return false;
+	}
+
+	void *p = MAP_FAILED;
+
+	if (ftruncate(fd, sizeof(statssegment)) == 0)
+	{
+		p = mmap(nullptr, sizeof(statssegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+
+	::close(fd);
+
+	if (p == MAP_FAILED)
+	{
+		printf("STATS ERROR: can't map %s\n", target.c_str());
+		shm_unlink(target.c_str());
+		return false;
+	}
+
+	m_segment = new (p) statssegment;
+	m_segment->seq.store(0, std::memory_order_relaxed);
+	memset(&m_segment->data, 0, sizeof(statsdata));
+	m_segment->version = STATS_VERSION;
+	m_segment->size = sizeof(statssegment);
+	std::atomic_thread_fence(std::memory_order_release);
+	m_segment->magic = STATS_MAGIC;
+
+	m_name = target;
+	m_owner = true;
+	return true;
+}
+
+bool statsshm::open(const std::string &name)
+{
+	close();
+
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	void *p = mmap(nullptr, sizeof(statssegment), PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (p == MAP_FAILED)
+	{
+		return false;
+	}
+
+	auto s = static_cast<statssegment *>(p);
+
+	if (s->magic != STATS_MAGIC || s->version != STATS_VERSION || s->size != sizeof(statssegment))
+	{
+		printf("STATS ERROR: %s has another layout\n", name.c_str());
+		munmap(p, sizeof(statssegment));
+		return false;
+	}
+
+	m_segment = s;
+	m_name = name;
+	m_owner = false;
+	return true;
+}
+
+void statsshm::close()
+{
+	if (m_segment == nullptr)
+	{
+		return;
+	}
+
+	munmap(m_segment, sizeof(statssegment));
+	m_segment = nullptr;
+
+	if (m_owner)
+	{
+		shm_unlink(m_name.c_str());
+	}
+}
+
+void statsshm::write(const statsdata &d)
+{
+	if (m_segment == nullptr)
+	{
+		return;
+	}
+
+	uint32_t seq = m_segment->seq.load(std::memory_order_relaxed);
+
+	m_segment->seq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	memcpy(&m_segment->data, &d, sizeof(statsdata));
+
+	m_segment->seq.store(seq + 2, std::memory_order_release);
+}
+
+// gives up after a few torn copies, the writer updates a couple of times a second
+
+bool statsshm::read(statsdata &d)
+{
+	if (m_segment == nullptr)
+	{
+		return false;
+	}
+
+	for (int attempt = 0; attempt < 100; ++attempt)
+	{
+		uint32_t seq = m_segment->seq.load(std::memory_order_acquire);
+
+		if (seq & 1)
+		{
+			usleep(100);
+			continue;
+		}
+
+		memcpy(&d, &m_segment->data, sizeof(statsdata));
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (m_segment->seq.load(std::memory_order_relaxed) == seq)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
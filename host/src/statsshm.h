@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+// engine state published in a posix shared memory segment for plumtop.
+// one writer, any number of readers. the writer makes seq odd while it
+// writes, a reader copies the data and retries if seq was odd or moved.
+
+#define STATS_MAGIC 0x6d756c70		// "plum"
+#define STATS_VERSION 2
+#define STATS_TRACKS 8
+#define STATS_SLOTS 8
+#define STATS_NAME "/plumhost"
+
+struct statsslot
+{
+	char name[32];
+	float load;			// share of the period, since the previous update
+	float max_us;		// worst call since the node was created
+	uint32_t voices;
+	uint32_t used;
+
+	// hardware counters since the previous update, zero without them
+	float ipc;
+	float cache_mpki;
+	float branch_mpki;
+	float cycles_per_frame;
+};
+
+struct statstrack
+{
+	float load;
+	uint32_t slots;
+	statsslot slot[STATS_SLOTS];
+};
+
+struct statsdata
+{
+	uint32_t pid;
+	uint32_t samplerate;
+	uint32_t buffersize;
+	uint32_t workers;
+	uint64_t updated_ns;		// CLOCK_MONOTONIC of the writer
+	uint64_t xruns;
+	float midi_rate;			// events per second
+	float load;					// all tracks
+	uint32_t counters;			// 1 when the slots have hardware counters
+	uint32_t tracks;
+	statstrack track[STATS_TRACKS];
+};
+
+struct statssegment
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	std::atomic<uint32_t> seq;
+	statsdata data;
+};
+
+
+class statsshm
+{
+public:
+	~statsshm();
+
+	// the writer creates and finally removes the segment. when another
+	// running host has the name, it creates name.pid instead.
+	bool create(const std::string &name);
+	bool open(const std::string &name);
+	void close();
+
+	void write(const statsdata &d);
+	bool read(statsdata &d);
+
+private:
+	std::string m_name;
+	statssegment *m_segment {nullptr};
+	bool m_owner {false};
+};
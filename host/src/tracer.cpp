@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tracer.h"
+
+std::atomic<bool> g_tracing {false};
+
+struct traceevent
+{
+	uint64_t start;
+	uint64_t end;
+	const char *cat;
+	char name[24];
+};
+
+// single producer, the writer thread is the consumer
+struct tracering
+{
+	uint32_t tid {0};
+	std::string name;
+	bool named {false};
+
+	std::unique_ptr<traceevent[]> events {new traceevent[TRACE_EVENTS]};
+	std::atomic<uint64_t> head {0};
+	std::atomic<uint64_t> tail {0};
+	std::atomic<uint64_t> dropped {0};
+};
+
+static std::mutex s_mutex;
+static std::vector<std::unique_ptr<tracering>> s_rings;
+static thread_local tracering *t_ring {nullptr};
+
+static FILE *s_file {nullptr};
+static std::thread s_writer;
+static std::atomic<bool> s_quit {false};
+static uint64_t s_origin {0};
+static bool s_first {true};
+
+
+static tracering *ring(const char *name)
+{
+	if (t_ring == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(s_mutex);
+
+		s_rings.emplace_back(new tracering);
+		t_ring = s_rings.back().get();
+		t_ring->tid = s_rings.size();
+		t_ring->name = name ? name : "thread " + std::to_string(t_ring->tid);
+	}
+
+	return t_ring;
+}
+
+void trace_thread(const char *name)
+{
+	if (trace_enabled())
+	{
+		ring(name);
+	}
+}
+
+// a full ring drops the event
+
+void trace_event(const char *cat, const char *name, uint64_t start, uint64_t end)
+{
+	auto r = ring(nullptr);
+
+	uint64_t head = r->head.load(std::memory_order_relaxed);
+
+	if (head - r->tail.load(std::memory_order_acquire) >= TRACE_EVENTS)
+	{
+		r->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	auto &e = r->events[head % TRACE_EVENTS];
+	e.start = start;
+	e.end = end;
+	e.cat = cat;
+	strncpy(e.name, name, sizeof(e.name) - 1);
+	e.name[sizeof(e.name) - 1] = 0;
+
+	// the name goes into a json string as it is
+	for (char *c = e.name; *c; ++c)
+	{
+		if (*c == '"' || *c == '\\' || *c < ' ') *c = '\'';
+	}
+
+	r->head.store(head + 1, std::memory_order_release);
+}
+
+
+// complete events ("X"), so that a dropped event never leaves a span open
+
+static void write_event(const char *json)
+{
+	fprintf(s_file, "%s\n%s", s_first ? "" : ",", json);
+	s_first = false;
+}
+
+static void drain()
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+	char json[256];
+
+	for (auto &r : s_rings)
+	{
+		if (!r->named)
+		{
+			snprintf(json, sizeof(json), 
+				"{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s\"}}",
+				r->tid, r->name.c_str());
+			write_event(json);
+			r->named = true;
+		}
+
+		uint64_t tail = r->tail.load(std::memory_order_relaxed);
+		uint64_t head = r->head.load(std::memory_order_acquire);
+
+		for (; tail < head; ++tail)
+		{
+			auto &e = r->events[tail % TRACE_EVENTS];
+			double ts = (int64_t(e.start) - int64_t(s_origin)) * 1e-3;
+
+			snprintf(json, sizeof(json), 
+				"{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %u}",
+				e.name, e.cat, ts, (e.end - e.start) * 1e-3, r->tid);
+			write_event(json);
+		}
+
+		r->tail.store(tail, std::memory_order_release);
+	}
+}
+
+static void writer()
+{
+	while (!s_quit)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		drain();
+	}
+}
+
+bool trace_start(const char *filename)
+{
+	if (s_file)
+	{
+		return true;
+	}
+
+	s_file = fopen(filename, "w");
+	if (s_file == nullptr)
+	{
+		printf("TRACE ERROR: can't write %s\n", filename);
+		return false;
+	}
+
+	fprintf(s_file, "[");
+	s_first = true;
+	s_origin = load_clock();
+	s_quit = false;
+	s_writer = std::thread(writer);
+
+	g_tracing = true;
+	return true;
+}
+
+// the rings stay, threads may still hold them
+
+void trace_stop()
+{
+	if (s_file == nullptr)
+	{
+		return;
+	}
+
+	g_tracing = false;
+	s_quit = true;
+	s_writer.join();
+
+	drain();
+
+	uint64_t dropped = 0;
+	for (auto &r : s_rings)
+	{
+		dropped += r->dropped.load();
+	}
+
+	fprintf(s_file, "\n]\n");
+	fclose(s_file);
+	s_file = nullptr;
+
+	if (dropped)
+	{
+		printf("TRACE: %lu events dropped, the rings were full\n", (unsigned long)dropped);
+	}
+}
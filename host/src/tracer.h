@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include "loadstats.h"
+
+// optional timeline of the audio, worker and gui threads, written in the
+// chrome trace event format (chrome://tracing or ui.perfetto.dev).
+// each thread records into its own preallocated ring, a background thread
+// writes them out. nothing is recorded unless trace_start() was called.
+
+#define TRACE_EVENTS 16384		// per thread
+
+extern std::atomic<bool> g_tracing;
+
+inline bool trace_enabled()
+{
+	return g_tracing.load(std::memory_order_relaxed);
+}
+
+bool trace_start(const char *filename);
+void trace_stop();
+
+// names the calling thread and allocates its ring. a thread that records
+// without it gets its ring on the first event.
+void trace_thread(const char *name);
+
+// cat must be a literal, name is copied. times come from load_clock().
+void trace_event(const char *cat, const char *name, uint64_t start, uint64_t end);
+
+
+struct tracescope
+{
+	const char *cat;
+	const char *name;
+	uint64_t start;
+
+	tracescope(const char *c, const char *n) : cat(c), name(n), start(trace_enabled() ? load_clock() : 0) 
+	{
+	}
+
+	~tracescope()
+	{
+		if (start)
+		{
+			trace_event(cat, name, start, load_clock());
+		}
+	}
+};
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+#include <algorithm>
+
+#include "wav.h"
+
+static void put16(FILE *f, uint16_t v)
+{
+	uint8_t b[2] {uint8_t(v), uint8_t(v >> 8)};
+	fwrite(b, 1, 2, f);
+}
+
+static uint32_t get(const uint8_t *p, int n)
+{
+	uint32_t v = 0;
+
+	for (int i = n - 1; i >= 0; --i)
+	{
+		v = (v << 8) | p[i];
+	}
+
+	return v;
+}
+
+static void put32(FILE *f, uint32_t v)
+{
+	uint8_t b[4] {uint8_t(v), uint8_t(v >> 8), uint8_t(v >> 16), uint8_t(v >> 24)};
+	fwrite(b, 1, 4, f);
+}
+
+
+wavwriter::~wavwriter()
+{
+	close();
+}
+
+bool wavwriter::open(const std::string &path, uint32_t samplerate, uint32_t channels, bool raw)
+{
+	close();
+
+	m_file = fopen(path.c_str(), "wb");
+
+	if (m_file == nullptr)
+	{
+		printf("WAV ERROR: can't create %s\n", path.c_str());
+		return false;
+	}
+
+	m_raw = raw;
+	m_samplerate = samplerate;
+	m_channels = channels;
+	m_frames = 0;
+
+	if (!m_raw)
+	{
+		header(0);
+	}
+
+	return true;
+}
+
+// the samples are written in the byte order of the machine, little endian
+
+bool wavwriter::write(float **chans, uint32_t nframes)
+{
+	m_interleaved.resize(nframes * m_channels);
+
+	for (uint32_t i = 0; i < nframes; ++i)
+	{
+		for (uint32_t c = 0; c < m_channels; ++c)
+		{
+			m_interleaved[i * m_channels + c] = chans[c][i];
+		}
+	}
+
+	if (fwrite(m_interleaved.data(), sizeof(float), m_interleaved.size(), m_file) != m_interleaved.size())
+	{
+		printf("WAV ERROR: write failed\n");
+		return false;
+	}
+
+	m_frames += nframes;
+	return true;
+}
+
+void wavwriter::close()
+{
+	if (m_file == nullptr)
+	{
+		return;
+	}
+
+	if (!m_raw)
+	{
+		fseek(m_file, 0, SEEK_SET);
+		header(m_frames);
+	}
+
+	fclose(m_file);
+	m_file = nullptr;
+}
+
+void wavwriter::header(uint32_t frames)
+{
+	uint32_t bytes = frames * m_channels * sizeof(float);
+
+	fwrite("RIFF", 1, 4, m_file);
+	put32(m_file, 36 + bytes);
+	fwrite("WAVE", 1, 4, m_file);
+
+	fwrite("fmt ", 1, 4, m_file);
+	put32(m_file, 16);
+	put16(m_file, 3);							// IEEE float
+	put16(m_file, m_channels);
+	put32(m_file, m_samplerate);
+	put32(m_file, m_samplerate * m_channels * sizeof(float));
+	put16(m_file, m_channels * sizeof(float));
+	put16(m_file, 32);
+
+	fwrite("data", 1, 4, m_file);
+	put32(m_file, bytes);
+}
+
+
+
+// ------------------------------------------------------------------------------------
+// READER
+// ------------------------------------------------------------------------------------
+
+wavreader::~wavreader()
+{
+	close();
+}
+
+void wavreader::close()
+{
+	if (m_file)
+	{
+		fclose(m_file);
+		m_file = nullptr;
+	}
+}
+
+uint32_t wavreader::samplerate()
+{
+	return m_samplerate;
+}
+
+bool wavreader::open(const std::string &path, bool raw)
+{
+	close();
+
+	m_file = fopen(path.c_str(), "rb");
+
+	if (m_file == nullptr)
+	{
+		printf("WAV ERROR: can't open %s\n", path.c_str());
+		return false;
+	}
+
+	if (raw)
+	{
+		m_channels = 2;
+		m_bits = 32;
+		m_remaining = UINT64_MAX;
+		return true;
+	}
+
+	uint8_t riff[12];
+
+	if (fread(riff, 1, 12, m_file) != 12 || memcmp(riff, "RIFF", 4) || memcmp(riff + 8, "WAVE", 4))
+	{
+		printf("WAV ERROR: %s is not a wave file\n", path.c_str());
+		close();
+		return false;
+	}
+
+	// walk the chunks up to the samples
+
+	uint32_t format = 0;
+	uint8_t chunk[8];
+
+	while (fread(chunk, 1, 8, m_file) == 8)
+	{
+		uint32_t size = get(chunk + 4, 4);
+
+		if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16)
+		{
+			uint8_t fmt[16];
+			if (fread(fmt, 1, 16, m_file) != 16) break;
+
+			format = get(fmt, 2);
+			m_channels = get(fmt + 2, 2);
+			m_samplerate = get(fmt + 4, 4);
+			m_bits = get(fmt + 14, 2);
+
+			fseek(m_file, size - 16 + (size & 1), SEEK_CUR);
+		}
+		else if (memcmp(chunk, "data", 4) == 0)
+		{
+			bool pcm16 = format == 1 && m_bits == 16;
+			bool float32 = format == 3 && m_bits == 32;
+
+			if ((!pcm16 && !float32) || m_channels < 1 || m_channels > 2)
+			{
+				printf("WAV ERROR: %s: only 16 bit pcm or 32 bit float, mono or stereo\n", path.c_str());
+				close();
+				return false;
+			}
+
+			m_remaining = size / (m_channels * m_bits / 8);
+			return true;
+		}
+		else
+		{
+			fseek(m_file, size + (size & 1), SEEK_CUR);
+		}
+	}
+
+	printf("WAV ERROR: %s has no samples\n", path.c_str());
+	close();
+	return false;
+}
+
+uint32_t wavreader::read(float **chans, uint32_t nframes)
+{
+	uint32_t n = 0;
+
+	if (m_file)
+	{
+		uint32_t frame = m_channels * m_bits / 8;
+		uint32_t want = std::min<uint64_t>(nframes, m_remaining);
+
+		m_bytes.resize(want * frame);
+		n = fread(m_bytes.data(), frame, want, m_file);
+		m_remaining -= n;
+
+		for (uint32_t i = 0; i < n; ++i)
+		{
+			for (uint32_t c = 0; c < 2; ++c)
+			{
+				const uint8_t *p = m_bytes.data() + i * frame + (c % m_channels) * m_bits / 8;
+
+				if (m_bits == 16)
+				{
+					chans[c][i] = int16_t(get(p, 2)) / 32768.f;
+				}
+				else
+				{
+					uint32_t bits = get(p, 4);
+					memcpy(&chans[c][i], &bits, 4);
+				}
+			}
+		}
+	}
+
+	for (uint32_t c = 0; c < 2; ++c)
+	{
+		std::fill(chans[c] + n, chans[c] + nframes, 0);
+	}
+
+	return n;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// writes 32 bit float wave files, the sizes are patched on close().
+// raw files are the interleaved samples alone.
+
+class wavwriter
+{
+public:
+	~wavwriter();
+
+	bool open(const std::string &path, uint32_t samplerate, uint32_t channels, bool raw = false);
+	bool write(float **chans, uint32_t nframes);
+	void close();
+
+private:
+	void header(uint32_t frames);
+
+	FILE *m_file {nullptr};
+	bool m_raw {false};
+	uint32_t m_samplerate {0};
+	uint32_t m_channels {0};
+	uint64_t m_frames {0};
+	std::vector<float> m_interleaved;
+};
+
+
+// reads 16 bit pcm and 32 bit float wave files, or raw interleaved 
+// 32 bit float stereo. a mono file fills both channels.
+
+class wavreader
+{
+public:
+	~wavreader();
+
+	bool open(const std::string &path, bool raw = false);
+	void close();
+
+	uint32_t samplerate();
+
+	// frames read into two channels, the rest of the block is zeroed
+	uint32_t read(float **chans, uint32_t nframes);
+
+private:
+	FILE *m_file {nullptr};
+	uint32_t m_samplerate {0};
+	uint32_t m_channels {2};
+	uint32_t m_bits {32};
+	uint64_t m_remaining {0};
+	std::vector<uint8_t> m_bytes;
+};
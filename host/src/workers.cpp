@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "workers.h"
+#include "tracer.h"
+#include "perfcounters.h"
+#include "rtcheck.h"
+
+static void futex_wait(std::atomic<uint32_t> *word, uint32_t value)
+{
+	syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t> *word, int count)
+{
+	syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+
+workerpool::~workerpool()
+{
+	stop();
+}
+
+void workerpool::start(uint32_t count)
+{
+	stop();
+
+	m_quit = false;
+
+	uint32_t generation = m_generation.load();
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		m_threads.emplace_back(&workerpool::loop, this, i + 1, generation);
+	}
+}
+
+void workerpool::set_priority(int priority)
+{
+	if (priority <= 0)
+	{
+		return;
+	}
+
+	sched_param param;
+	param.sched_priority = priority;
+
+	for (auto &t : m_threads)
+	{
+		if (pthread_setschedparam(t.native_handle(), SCHED_FIFO, &param))
+		{
+			printf("WORKERS: can't set realtime priority %d\n", priority);
+			break;
+		}
+	}
+}
+
+void workerpool::stop()
+{
+	if (m_threads.empty())
+	{
+		return;
+	}
+
+	m_quit = true;
+	m_generation.fetch_add(1, std::memory_order_release);
+	futex_wake(&m_generation, m_threads.size());
+
+	for (auto &t : m_threads)
+	{
+		t.join();
+	}
+
+	m_threads.clear();
+}
+
+uint32_t workerpool::size()
+{
+	return m_threads.size() + 1;
+}
+
+void workerpool::run(task fn, void *arg)
+{
+	uint32_t n = m_threads.size();
+
+	if (n == 0)
+	{
+		fn(arg, 0);
+		return;
+	}
+
+	m_task = fn;
+	m_arg = arg;
+	m_pending.store(n, std::memory_order_relaxed);
+	m_generation.fetch_add(1, std::memory_order_release);
+	futex_wake(&m_generation, n);
+
+	fn(arg, 0);
+
+	uint32_t pending;
+	for (int spin = 0; (pending = m_pending.load(std::memory_order_acquire)) != 0; ++spin)
+	{
+		if (spin < 2000)
+		{
+			cpu_relax();
+		}
+		else
+		{
+			futex_wait(&m_pending, pending);
+		}
+	}
+}
+
+void workerpool::loop(uint32_t index, uint32_t seen)
+{
+	trace_thread(("worker " + std::to_string(index)).c_str());
+	perf_thread();
+
+	for (;;)
+	{
+		uint32_t g;
+		while ((g = m_generation.load(std::memory_order_acquire)) == seen)
+		{
+			futex_wait(&m_generation, seen);
+		}
+
+		seen = g;
+
+		if (m_quit)
+		{
+			break;
+		}
+
+		{
+			rtscope rt;
+			m_task(m_arg, index);
+		}
+
+		if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			futex_wake(&m_pending, 1);
+		}
+	}
+}
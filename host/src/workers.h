@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// a pool of realtime threads woken once per audio callback.
+// run() executes the task on every worker and on the calling thread, 
+// the task splits the work itself (e.g. with an atomic counter).
+// start() and stop() must not overlap a run().
+
+class workerpool
+{
+public:
+	typedef void (*task)(void *arg, uint32_t worker);
+
+	~workerpool();
+
+	void start(uint32_t count);
+	void stop();
+	void set_priority(int priority);
+
+	void run(task fn, void *arg);
+	uint32_t size();
+
+private:
+	void loop(uint32_t index, uint32_t seen);
+
+	std::vector<std::thread> m_threads;
+
+	std::atomic<uint32_t> m_generation {0};
+	std::atomic<uint32_t> m_pending {0};
+	std::atomic<bool> m_quit {false};
+
+	task m_task {nullptr};
+	void *m_arg {nullptr};
+};
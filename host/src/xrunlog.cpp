@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "xrunlog.h"
+#include "loadstats.h"
+
+
+// ------------------------------------------------------------------------------------
+// HISTOGRAM
+// ------------------------------------------------------------------------------------
+
+static void add(std::atomic<uint64_t> &counter, uint64_t value)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// values below 16 have a bucket each, then 16 buckets per power of two
+
+uint32_t hdrhistogram::index(uint64_t ns)
+{
+	if (ns < sub_buckets)
+	{
+		return ns;
+	}
+
+	uint32_t msb = 63 - __builtin_clzll(ns);
+	uint32_t i = (msb - 3) * sub_buckets + ((ns >> (msb - 4)) & (sub_buckets - 1));
+	return std::min(i, buckets - 1);
+}
+
+uint64_t hdrhistogram::value(uint32_t bucket)
+{
+	if (bucket < sub_buckets)
+	{
+		return bucket;
+	}
+
+	uint32_t msb = bucket / sub_buckets + 3;
+	return uint64_t(sub_buckets + bucket % sub_buckets) << (msb - 4);
+}
+
+void hdrhistogram::record(uint64_t ns)
+{
+	add(m_counts[index(ns)], 1);
+
+	if (ns > m_max.load(std::memory_order_relaxed))
+	{
+		m_max.store(ns, std::memory_order_relaxed);
+	}
+}
+
+uint64_t hdrhistogram::at(uint32_t bucket)
+{
+	return m_counts[bucket].load(std::memory_order_relaxed);
+}
+
+uint64_t hdrhistogram::count()
+{
+	uint64_t n = 0;
+
+	for (uint32_t i = 0; i < buckets; ++i)
+	{
+		n += at(i);
+	}
+
+	return n;
+}
+
+uint64_t hdrhistogram::max()
+{
+	return m_max.load(std::memory_order_relaxed);
+}
+
+// the lowest value of the bucket holding the q-th fraction of the samples
+
+uint64_t hdrhistogram::percentile(double q)
+{
+	uint64_t total = count();
+	if (total == 0)
+	{
+		return 0;
+	}
+
+	uint64_t rank = std::max<uint64_t>(1, uint64_t(q * total + 0.5));
+	uint64_t n = 0;
+
+	for (uint32_t i = 0; i < buckets; ++i)
+	{
+		n += at(i);
+
+		if (n >= rank)
+		{
+			return value(i);
+		}
+	}
+
+	return max();
+}
+
+
+// ------------------------------------------------------------------------------------
+// LOG
+// ------------------------------------------------------------------------------------
+
+xrunlog::xrunlog()
+{
+	m_blocks.reset(new blocktiming[XRUN_HISTORY]);
+	m_xruns.reset(new xrunslot[XRUN_RECORDS]);
+}
+
+void xrunlog::xrun(float delay_us)
+{
+	m_pending_delay.store(delay_us, std::memory_order_relaxed);
+	m_pending.fetch_add(1, std::memory_order_release);
+	m_reported.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t xrunlog::count_xruns()
+{
+	return m_reported.load(std::memory_order_relaxed);
+}
+
+// the blocks before the xrun, the oldest first
+
+void xrunlog::capture(float delay_us)
+{
+	uint64_t n = m_xrun_count.load(std::memory_order_relaxed);
+	auto &slot = m_xruns[n % XRUN_RECORDS];
+
+	slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	auto &r = slot.record;
+	r.at = load_clock();
+	r.delay_us = delay_us;
+	r.blocks = std::min<uint64_t>(m_block, XRUN_HISTORY);
+
+	for (uint32_t i = 0; i < r.blocks; ++i)
+	{
+		auto &b = m_blocks[(m_block - r.blocks + i) % XRUN_HISTORY];
+		r.history[i] = b;
+	}
+
+	slot.seq.store(2 * n + 2, std::memory_order_release);
+	m_xrun_count.store(n + 1, std::memory_order_release);
+}
+
+void xrunlog::begin(uint32_t nframes, uint32_t samplerate, int64_t jitter_ns)
+{
+	if (m_pending.load(std::memory_order_relaxed) && m_pending.exchange(0, std::memory_order_acquire))
+	{
+		capture(m_pending_delay.load(std::memory_order_relaxed));
+	}
+
+	m_current = &m_blocks[m_block % XRUN_HISTORY];
+	m_current->start = load_clock();
+	m_current->nframes = nframes;
+	m_current->period = samplerate ? uint64_t(nframes) * 1000000000ull / samplerate : 0;
+	m_current->jitter = std::max<int64_t>(INT32_MIN, std::min<int64_t>(INT32_MAX, jitter_ns));
+	m_current->nodes = 0;
+
+	m_jitter.record(std::max<int64_t>(0, jitter_ns));
+}
+
+void xrunlog::node(uint32_t track, const char *name, uint64_t ns)
+{
+	if (m_current == nullptr || m_current->nodes == XRUN_NODES)
+	{
+		return;
+	}
+
+	auto &n = m_current->node[m_current->nodes++];
+	n.track = track;
+	n.ns = std::min<uint64_t>(ns, UINT32_MAX);
+	strncpy(n.name, name, sizeof(n.name) - 1);
+	n.name[sizeof(n.name) - 1] = 0;
+}
+
+void xrunlog::end()
+{
+	if (m_current == nullptr)
+	{
+		return;
+	}
+
+	uint64_t ns = load_clock() - m_current->start;
+	m_current->duration = std::min<uint64_t>(ns, UINT32_MAX);
+	m_duration.record(ns);
+
+	m_current = nullptr;
+	++m_block;
+}
+
+
+// ------------------------------------------------------------------------------------
+// DUMP
+// ------------------------------------------------------------------------------------
+
+static void dump_histogram(FILE *f, const char *title, hdrhistogram &h)
+{
+	fprintf(f, "%s: %lu callbacks, p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+		title, (unsigned long)h.count(), h.percentile(0.5) * 1e-3, h.percentile(0.9) * 1e-3,
+		h.percentile(0.99) * 1e-3, h.percentile(0.999) * 1e-3, h.max() * 1e-3);
+
+	for (uint32_t i = 0; i < hdrhistogram::buckets; ++i)
+	{
+		if (h.at(i))
+		{
+			fprintf(f, "  >= %10.1f us  %lu\n", hdrhistogram::value(i) * 1e-3, (unsigned long)h.at(i));
+		}
+	}
+
+	fprintf(f, "\n");
+}
+
+// a record being overwritten while it is copied is left out
+
+bool xrunlog::dump(const std::string &filename)
+{
+	FILE *f = fopen(filename.c_str(), "w");
+	if (f == nullptr)
+	{
+		printf("XRUN ERROR: can't write %s\n", filename.c_str());
+		return false;
+	}
+
+	dump_histogram(f, "callback duration", m_duration);
+	dump_histogram(f, "wake-up jitter", m_jitter);
+
+	uint64_t count = m_xrun_count.load(std::memory_order_acquire);
+	uint64_t first = count > XRUN_RECORDS ? count - XRUN_RECORDS : 0;
+
+	fprintf(f, "%lu xruns reported, the last %lu follow\n\n", 
+		(unsigned long)count_xruns(), (unsigned long)(count - first));
+
+	std::unique_ptr<xrunrecord> r(new xrunrecord);
+
+	for (uint64_t n = first; n < count; ++n)
+	{
+		auto &slot = m_xruns[n % XRUN_RECORDS];
+
+		uint64_t seq = slot.seq.load(std::memory_order_acquire);
+		*r = slot.record;
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (seq != 2 * n + 2 || slot.seq.load(std::memory_order_relaxed) != seq)
+		{
+			continue;
+		}
+
+		fprintf(f, "xrun %lu at %.6f s, delayed %.1f us\n", 
+			(unsigned long)n + 1, r->at * 1e-9, r->delay_us);
+
+		for (uint32_t i = 0; i < r->blocks; ++i)
+		{
+			auto &b = r->history[i];
+
+			fprintf(f, "  block %d at %.6f s: %u frames, callback %.1f us of %.1f us, jitter %.1f us\n",
+				int(i) - int(r->blocks), b.start * 1e-9, b.nframes, 
+				b.duration * 1e-3, b.period * 1e-3, b.jitter * 1e-3);
+
+			for (uint32_t k = 0; k < b.nodes; ++k)
+			{
+				fprintf(f, "    track %u  %-24s %8.1f us\n", 
+					b.node[k].track + 1, b.node[k].name, b.node[k].ns * 1e-3);
+			}
+		}
+
+		fprintf(f, "\n");
+	}
+
+	fclose(f);
+	return true;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+// per callback timing, kept by the audio thread without locks or allocations.
+// when an xrun is reported, the next callback copies the timing of the last
+// blocks into a ring of xrun records, which dump() writes out for a post-mortem.
+
+#define XRUN_HISTORY 32		// blocks kept per xrun
+#define XRUN_NODES 48		// nodes kept per block
+#define XRUN_RECORDS 16		// xruns kept
+
+// HDR style histogram of nanoseconds: 16 linear steps per power of two,
+// 6% resolution up to about 1000 s. one writer, any number of readers.
+
+class hdrhistogram
+{
+public:
+	static const uint32_t sub_buckets = 16;
+	static const uint32_t buckets = 592;
+
+	void record(uint64_t ns);
+	uint64_t count();
+	uint64_t percentile(double q);
+	uint64_t max();
+
+	// lowest value of a bucket
+	static uint64_t value(uint32_t bucket);
+	uint64_t at(uint32_t bucket);
+
+private:
+	static uint32_t index(uint64_t ns);
+
+	std::atomic<uint64_t> m_counts[buckets] {};
+	std::atomic<uint64_t> m_max {0};
+};
+
+
+struct nodetiming
+{
+	uint32_t track;
+	uint32_t ns;
+	char name[24];
+};
+
+struct blocktiming
+{
+	uint64_t start {0};			// load_clock() at the start of the callback
+	uint32_t duration {0};		// ns
+	uint32_t period {0};		// ns of audio in the block
+	int32_t jitter {0};			// wake-up delay after the period started, ns
+	uint32_t nframes {0};
+	uint32_t nodes {0};
+	nodetiming node[XRUN_NODES];
+};
+
+struct xrunrecord
+{
+	uint64_t at {0};
+	float delay_us {0};
+	uint32_t blocks {0};
+	blocktiming history[XRUN_HISTORY];
+};
+
+
+class xrunlog
+{
+public:
+	xrunlog();
+
+	// audio thread, around each callback
+	void begin(uint32_t nframes, uint32_t samplerate, int64_t jitter_ns);
+	void node(uint32_t track, const char *name, uint64_t ns);
+	void end();
+
+	// any thread, jack calls it from its notification thread
+	void xrun(float delay_us);
+
+	// not the audio thread
+	uint64_t count_xruns();
+	bool dump(const std::string &filename);
+
+private:
+	void capture(float delay_us);
+
+	hdrhistogram m_duration;
+	hdrhistogram m_jitter;
+
+	// audio thread only
+	std::unique_ptr<blocktiming[]> m_blocks;
+	uint64_t m_block {0};
+	blocktiming *m_current {nullptr};
+
+	std::atomic<uint32_t> m_pending {0};
+	std::atomic<float> m_pending_delay {0};
+
+	// written by the audio thread, an odd sequence means the slot is being written
+	struct xrunslot
+	{
+		std::atomic<uint64_t> seq {0};
+		xrunrecord record;
+	};
+
+	std::unique_ptr<xrunslot[]> m_xruns;
+	std::atomic<uint64_t> m_xrun_count {0};
+	std::atomic<uint64_t> m_reported {0};
+};
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "plum.h"
+
+// optional interfaces shared by the demo host and plugins,
+// reached through iobject::as()
+
+#define IFID_PLUM_INPLACE "plum.inplace"
+#define IFID_PLUM_EVENTS "plum.events"
+#define IFID_PLUM_TAIL "plum.tail"
+#define IFID_PLUM_LATENCY "plum.latency"
+#define IFID_PLUM_BLOCKSIZE "plum.blocksize"
+#define IFID_PLUM_VOICES "plum.voices"
+#define IFID_PLUM_JOBS "plum.jobs"
+
+#define PLUM_TAIL_INFINITE 0xFFFFFFFF
+
+// a short midi message at a frame of the current block
+struct plum_event
+{
+	uint32_t frame;
+	uint32_t size;
+	uint8_t data[4];
+};
+
+namespace plum {
+
+// the plugin accepts the same buffer as input and output (ins[i] == outs[i])
+class iinplace : public iobject
+{
+};
+
+// processes a whole block with its events, sorted by frame (frame < nframes).
+// plugins without it get the block split at every event.
+class ievents : public iobject
+{
+public:
+	virtual void process_events(uint32_t nframes, float **ins, float **outs, 
+		const plum_event *events, uint32_t count) = 0;
+};
+
+// frames of sound the plugin still produces after its inputs and events went
+// silent, asked on the audio thread before every block. once the silence lasts
+// longer than that the host stops calling process. plugins without it never sleep.
+class itail : public iobject
+{
+public:
+	virtual uint32_t get_tail() = 0;
+};
+
+// frames between an input and the matching output, asked when the host
+// rebuilds its graph. a plugin with itail counts the latency in its tail.
+class ilatency : public iobject
+{
+public:
+	virtual uint32_t get_latency() = 0;
+};
+
+// the plugin wants to process blocks of exactly this many frames. the host
+// re-blocks its audio and events for it, adds a block of latency, and passes
+// the size to configure().
+class iblocksize : public iobject
+{
+public:
+	virtual uint32_t get_block_size() = 0;
+};
+
+// voices sounding after the last block, for meters. asked from any thread.
+class ivoices : public iobject
+{
+public:
+	virtual uint32_t count_voices() = 0;
+};
+
+// asked from the host: runs fn(arg, index) for index 0 to count - 1 on the
+// worker threads of the host and the calling one, and returns when all are
+// done. call it from process only. the jobs must be realtime safe and must not
+// submit jobs themselves. count_threads tells how many threads may take part.
+class ijobs : public iobject
+{
+public:
+	typedef void (*job)(void *arg, uint32_t index);
+
+	virtual uint32_t count_threads() = 0;
+	virtual void run_jobs(job fn, void *arg, uint32_t count) = 0;
+};
+
+} // plum
@@ -27,6 +27,7 @@
 
 #include "plum.h"
 #include "plumhelpers.h"
+#include "plumext.h"
 
 
 #include "../abcdwindow.h"
@@ -36,7 +37,7 @@ namespace demo {
 
 class GainGui;
 
-class Gain : public plum::iplugin
+class Gain : public plum::iplugin, public plum::iinplace, public plum::itail
 {
 	friend class GainGui;
 
@@ -53,6 +54,14 @@ public:
 		{
 			reference(); return static_cast<plum::iplugin *>(this);
 		}
+		else if (std::string(ifid) == IFID_PLUM_INPLACE)
+		{
+			reference(); return static_cast<plum::iinplace *>(this);
+		}
+		else if (std::string(ifid) == IFID_PLUM_TAIL)
+		{
+			reference(); return static_cast<plum::itail *>(this);
+		}
 
 		return nullptr;
 	}
@@ -73,6 +82,9 @@ public:
 	void midi_event(uint8_t *data) override									{}
 	void process(uint32_t nframes, float **ins, float **outs) override;
 
+	// one frame keeps it awake for one silent block, which zeroes the meter
+	uint32_t get_tail() override											{return 1;}
+
 	plum::istring* get_preset_name(uint32_t index) override					{return nullptr;}
 	void set_preset_name(uint32_t index, plum::istring *) override			{}
 
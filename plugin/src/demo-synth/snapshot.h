@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+namespace demo {
+
+// a triple buffer: one thread publishes whole values, another takes the
+// latest of them when it wants. neither waits, and the reader never sees a
+// value half written. each published value gets the next version.
+
+template <typename T>
+class snapshot
+{
+public:
+
+	// writer: fill back(), then publish() it
+
+	T &back()
+	{
+		return m_slot[m_back].value;
+	}
+
+	void publish()
+	{
+		m_slot[m_back].version = ++m_version;
+		m_back = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// reader: true when fetch() moved front() to a newer value
+
+	bool fetch()
+	{
+		if ((m_middle.load(std::memory_order_relaxed) & FRESH) == 0)
+		{
+			return false;
+		}
+
+		m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	const T &front() const
+	{
+		return m_slot[m_front].value;
+	}
+
+	uint32_t version() const
+	{
+		return m_slot[m_front].version;
+	}
+
+private:
+	enum : uint8_t {INDEX = 3, FRESH = 4};
+
+	struct alignas(64) slot
+	{
+		T value {};
+		uint32_t version {0};
+	};
+
+	slot m_slot[3];
+
+	// the writer owns m_back, the reader m_front, they trade through m_middle
+	alignas(64) std::atomic<uint8_t> m_middle {1};
+	alignas(64) uint8_t m_back {0};
+	uint32_t m_version {0};
+	alignas(64) uint8_t m_front {2};
+};
+
+
+} // demo
@@ -20,6 +20,7 @@
  * SOFTWARE.
  */
 
+#include <stdlib.h>
 #include <fstream>
 #include <sstream>
 
@@ -35,7 +36,23 @@ DSynth::DSynth(plum::ihost *host, bool nogui)
 
 	m_host = host;
 	m_nogui = nogui;
-	m_voice.resize(m_voice_count);
+
+	m_jobs = (plum::ijobs *)m_host->as(IFID_PLUM_JOBS);
+	m_voices.set_jobs(m_jobs);
+	m_reference = getenv("DSYNTH_REFERENCE") != nullptr;
+
+	const char *voices = getenv("DSYNTH_VOICES");
+	if (voices)
+	{
+		m_polyphony = std::min<uint32_t>(std::max(1, atoi(voices)), DSYNTH_MAX_VOICES);
+	}
+
+	if (m_reference)
+	{
+		printf("DSynth: tonic reference voices\n");
+		m_voice.resize(m_voice_count);
+		m_voice_pos.resize(m_voice_count);
+	}
 
 	m_bank[0].define(m_defs, {0, 0.10, 0.25, 0.25, 0.5, 2}, "Square 1");
 	m_bank[1].define(m_defs, {0, 0.35, 0.25, 0.25, 0.5, 2}, "Square 2");
@@ -50,6 +67,11 @@ DSynth::DSynth(plum::ihost *host, bool nogui)
 DSynth::~DSynth()
 { 
 	printf("DEL demo::DSynth\n"); 
+
+	if (m_jobs)
+	{
+		m_jobs->release();
+	}
 }
 
 const char *DSynth::get_name()
@@ -136,8 +158,7 @@ uint32_t DSynth::get_selected_preset()
 void DSynth::set_selected_preset(uint32_t index)
 {
 	m_current_preset = index;
-	m_bank[index].clone(m_preset_temp);
-	m_preset_temp = m_preset.exchange(m_preset_temp);
+	publish_patch();
 
 	if (m_gui)
 	{
@@ -164,7 +185,7 @@ float DSynth::get_parameter(uint32_t index)
 void DSynth::set_parameter(uint32_t index, float value)
 {
 	m_bank[m_current_preset].set(index, value);
-	m_preset.load()->set(index, value);
+	publish_patch();
 }
 
 void DSynth::get_parameter_def(uint32_t index, plum_param_def *def)
@@ -205,20 +226,15 @@ void DSynth::midi_event(uint8_t *data)
 	}
 }
 
-void DSynth::note_on(int number, int velocity)
+voice *DSynth::free_voice()
 {
 	auto it = std::find_if(m_voice.begin(), m_voice.end(), 
 		[](voice &voice) {return voice.is_free();});
 
-	if (it != m_voice.end())
-	{ 
-		it->start(number, velocity, 1, &m_preset);
-//printf("NOTE ON %d %ld\n", number, it - m_voice.begin());
-	}
-
+	return it != m_voice.end() ? &*it : nullptr;
 }
 
-void DSynth::note_off(int number, int velocity)
+voice *DSynth::held_voice(int number)
 {
 	auto it = std::find_if(m_voice.begin(), m_voice.end(), 
 		[number](voice &voice) 
@@ -227,10 +243,43 @@ void DSynth::note_off(int number, int velocity)
 		}
 	);
 
-	if (it != m_voice.end())
+	return it != m_voice.end() ? &*it : nullptr;
+}
+
+void DSynth::note_on(int number, int velocity)
+{
+	if (!m_reference)
 	{
-		it->release(velocity);
-//printf("NOTE OFF %d %ld\n", number, it - m_voice.begin());
+		auto &patch = m_live.front();
+		voiceparams params {patch.attack, patch.decay, patch.sustain, patch.release};
+		m_voices.note_on(number, 1, params, patch.pwm);
+		return;
+	}
+
+	auto v = free_voice();
+
+	if (v)
+	{ 
+		v->start(number, velocity, 1, m_live.front(), m_live.version());
+//printf("NOTE ON %d %ld\n", number, v - m_voice.data());
+	}
+
+}
+
+void DSynth::note_off(int number, int velocity)
+{
+	if (!m_reference)
+	{
+		m_voices.note_off(number);
+		return;
+	}
+
+	auto v = held_voice(number);
+
+	if (v)
+	{
+		v->release(velocity);
+//printf("NOTE OFF %d %ld\n", number, v - m_voice.data());
 	}
 
 }
@@ -239,6 +288,8 @@ void DSynth::note_off(int number, int velocity)
 void DSynth::configure(uint32_t samplerate, uint32_t buffer_size)
 {
 	Tonic::setSampleRate(samplerate);
+	m_voices.configure(samplerate, m_polyphony, buffer_size);
+	m_live.fetch();
 
 	m_bleft.resize(buffer_size);
 	m_bright.resize(buffer_size);
@@ -248,21 +299,135 @@ void DSynth::configure(uint32_t samplerate, uint32_t buffer_size)
 
 void DSynth::process(uint32_t nframes, float **ins, float **outs)
 {
+	process_events(nframes, ins, outs, nullptr, 0);
+}
+
+// the control thread's side: the whole patch goes out again on every change
+
+void DSynth::publish_patch()
+{
+	m_live.back().read(m_bank[m_current_preset]);
+	m_live.publish();
+}
+
+// all the voices advance together between the events
+
+void DSynth::process_events(uint32_t nframes, float **ins, float **outs, 
+	const plum_event *events, uint32_t count)
+{
+	m_live.fetch();
+
+	if (m_reference)
+	{
+		process_reference(nframes, outs, events, count);
+		return;
+	}
+
 	std::fill(outs[0], outs[0] + nframes, 0);
 	std::fill(outs[1], outs[1] + nframes, 0);
 
+	auto &patch = m_live.front();
+	uint32_t frame = 0;
+
+	for (uint32_t k = 0; k < count; ++k)
+	{
+		uint32_t at = std::min(events[k].frame, nframes);
+
+		if (at > frame)
+		{
+			m_voices.render(outs, frame, at, patch.square, patch.pwm, 1 / m_voice_count);
+			frame = at;
+		}
+
+		midi_event((uint8_t *)events[k].data);
+	}
+
+	m_voices.render(outs, frame, nframes, patch.square, patch.pwm, 1 / m_voice_count);
+	m_active.store(m_voices.count_active(), std::memory_order_relaxed);
+}
+
+void DSynth::process_reference(uint32_t nframes, float **outs, 
+	const plum_event *events, uint32_t count)
+{
+	std::fill(outs[0], outs[0] + nframes, 0);
+	std::fill(outs[1], outs[1] + nframes, 0);
+
+	std::fill(m_voice_pos.begin(), m_voice_pos.end(), 0);
+
 	for (auto &v : m_voice)
 	{
-		if (!v.is_free())
+		v.update(m_live.front(), m_live.version());
+	}
+
+	// only the voice an event touches is rendered up to the event frame,
+	// the others run the whole block in one go
+
+	for (uint32_t k = 0; k < count; ++k)
+	{
+		const uint8_t *data = events[k].data;
+		uint32_t frame = std::min(events[k].frame, nframes);
+		voice *v = nullptr;
+
+		switch (data[0] & 0xF0)
 		{
-			v.process(m_buffer, nframes);
+			case 0x90: v = free_voice(); break;
+			case 0x80: v = held_voice(data[1]); break;
+		}
 
-			for (size_t i = 0; i < nframes; ++i)
-			{
-				outs[0][i] += m_bleft[i] / m_voice_count;
-				outs[1][i] += m_bright[i] / m_voice_count;
-			}
+		if (!v)
+		{
+			continue;
 		}
+
+		size_t index = v - m_voice.data();
+		render_voice(index, m_voice_pos[index], frame, outs);
+		m_voice_pos[index] = frame;
+
+		midi_event((uint8_t *)data);
+	}
+
+	uint32_t active = 0;
+
+	for (size_t i = 0; i < m_voice.size(); ++i)
+	{
+		render_voice(i, m_voice_pos[i], nframes, outs);
+		active += !m_voice[i].is_free();
+	}
+
+	m_active.store(active, std::memory_order_relaxed);
+}
+
+// a sounding voice has no known end, an idle synth is silent right away
+
+uint32_t DSynth::get_tail()
+{
+	bool active = m_reference ? 
+		std::any_of(m_voice.begin(), m_voice.end(), [](voice &voice) {return !voice.is_free();}) :
+		m_voices.count_active() > 0;
+
+	return active ? PLUM_TAIL_INFINITE : 0;
+}
+
+uint32_t DSynth::count_voices()
+{
+	return m_active.load(std::memory_order_relaxed);
+}
+
+void DSynth::render_voice(size_t index, uint32_t from, uint32_t to, float **outs)
+{
+	auto &v = m_voice[index];
+
+	if (from >= to || v.is_free())
+	{
+		return;
+	}
+
+	v.process(m_buffer, to - from);
+
+	for (size_t i = 0; i < to - from; ++i)
+	{
+		outs[0][from + i] += m_bleft[i] / m_voice_count;
+		outs[1][from + i] += m_bright[i] / m_voice_count;
 	}
 }
 
@@ -376,9 +541,8 @@ plum::iblob *DSynth::get_preset_data()
 	append_uint32(0, buffer);
 	append_string("preset", buffer);
 	append_string(preset.name, buffer);
-	for (auto &p : preset.data)
+	for (auto v : preset.data)
 	{
-		auto v = p.load();
 		append_float32(v, buffer);			
 	}
 
@@ -458,9 +622,8 @@ plum::iblob *DSynth::get_bank_data()
 	for (auto &preset : m_bank)
 	{
 		append_string(preset.name, buffer);
-		for (auto &p : preset.data)
+		for (auto v : preset.data)
 		{
-			auto v = p.load();
 			append_float32(v, buffer);			
 		}
 	}
@@ -27,18 +27,23 @@
 
 #include "plum.h"
 #include "plumhelpers.h"
+#include "plumext.h"
 
 
 #include "../abcdwindow.h"
 
 #include "voice.h"
+#include "voicebank.h"
+#include "snapshot.h"
 
 namespace demo {
 
+#define DSYNTH_MAX_VOICES 256
 
 class DSynthGui;
 
-class DSynth : public plum::iplugin, public plum::istorage
+class DSynth : public plum::iplugin, public plum::istorage, public plum::ievents, 
+	public plum::itail, public plum::ivoices
 {
 	friend class DSynthGui;
 
@@ -59,6 +64,18 @@ public:
 		{
 			reference(); return static_cast<plum::istorage *>(this);
 		}
+		else if (std::string(ifid) == IFID_PLUM_EVENTS)
+		{
+			reference(); return static_cast<plum::ievents *>(this);
+		}
+		else if (std::string(ifid) == IFID_PLUM_TAIL)
+		{
+			reference(); return static_cast<plum::itail *>(this);
+		}
+		else if (std::string(ifid) == IFID_PLUM_VOICES)
+		{
+			reference(); return static_cast<plum::ivoices *>(this);
+		}
 
 		return nullptr;
 	}
@@ -81,6 +98,12 @@ public:
 	void midi_event(uint8_t *data) override;
 	void process(uint32_t nframes, float **ins, float **outs) override;
 
+	// EVENTS
+	void process_events(uint32_t nframes, float **ins, float **outs, 
+		const plum_event *events, uint32_t count) override;
+	uint32_t get_tail() override;
+	uint32_t count_voices() override;
+
 	// PRESETS
 	uint32_t count_presets() override;
 	uint32_t get_selected_preset() override;
@@ -112,20 +135,36 @@ private:
 
 	void note_on(int number, int velocity);
 	void note_off(int number, int velocity);
+	voice *free_voice();
+	voice *held_voice(int number);
+	void render_voice(size_t index, uint32_t from, uint32_t to, float **outs);
+	void process_reference(uint32_t nframes, float **outs, const plum_event *events, uint32_t count);
+	void publish_patch();
 
 	plum::ihost *m_host {nullptr};
+	plum::ijobs *m_jobs {nullptr};		// the host's, when it has them
 	DSynthGui *m_gui {nullptr};
 	bool m_nogui;
 
 	std::array<const char *, 2> channel_names {"left", "right"};
 
 	uint32_t m_current_preset {0};
-	std::array<preset_t, 2> m_preset_pool;
-	std::atomic<preset_t *> m_preset {&m_preset_pool[1]};
-	preset_t *m_preset_temp {&m_preset_pool[0]};	
 
+	// the selected preset, published by the control thread on every change
+	// and fetched by the audio thread once per block
+	snapshot<voicepatch> m_live;
+
+	// DSYNTH_VOICES sets the polyphony, up to DSYNTH_MAX_VOICES. the mix is
+	// scaled for 8 voices whatever it is.
 	const float m_voice_count = 8;
+	uint32_t m_polyphony {32};
+	voicebank m_voices;
+
+	// DSYNTH_REFERENCE renders with the tonic voices instead, to compare
+	bool m_reference {false};
 	std::vector<voice> m_voice;
+	std::vector<uint32_t> m_voice_pos;
+	std::atomic<uint32_t> m_active {0};
 	std::vector<float> m_bleft;
 	std::vector<float> m_bright;
 	float *m_buffer[2];
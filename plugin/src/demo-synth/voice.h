@@ -22,7 +22,7 @@
 
 #pragma once
 
-#include <atomic>
+#include <string>
 #include "plum.h"
 
 #pragma GCC diagnostic push
@@ -48,10 +48,13 @@ enum dsynth_param_id
 };
 
 
+// the bank belongs to the control thread, the audio thread gets the live
+// preset as a voicepatch snapshot
+
 struct preset_t
 {
 	plum_param_def *defs;
-	std::atomic<float> data[param_count];
+	float data[param_count];
 	std::string name;
 
 	void define(plum_param_def *x, const float (&y)[param_count], std::string z)
@@ -61,7 +64,7 @@ struct preset_t
 		for (int i = 0; i < param_count; ++i) data[i] = y[i];
 	}
 
-	float get(uint32_t index)
+	float get(uint32_t index) const
 	{
 		return data[index];
 	}
@@ -73,12 +76,28 @@ struct preset_t
 		v = std::max(p->min, v);				
 		data[index] = v;
 	}
+};
+
+
+// what the voices take from the preset, fetched once per block
 
-	void clone(preset_t *np)
+struct voicepatch
+{
+	bool square {true};
+	float pwm {0.5};
+	float attack {0.25};
+	float decay {0.25};
+	float sustain {0.5};
+	float release {0.25};
+
+	void read(const preset_t &p)
 	{
-		np->defs = defs;
-		np->name = name;
-		for (int i = 0; i < param_count; ++i) np->data[i] = data[i].load();
+		square = round(p.get(osctype)) == 0;
+		pwm = p.get(dsynth_param_id::pwm);
+		attack = p.get(dsynth_param_id::attack);
+		decay = p.get(dsynth_param_id::decay);
+		sustain = p.get(dsynth_param_id::sustain);
+		release = p.get(dsynth_param_id::release);
 	}
 };
 
@@ -88,6 +107,9 @@ class voice : public Tonic::Synth
 {
 public:
 	
+	// the parameters are bound once here, the audio thread sets them through
+	// the handles and never looks them up by name
+
 	voice()
 	{
 		Tonic::ADSR adsr;
@@ -98,82 +120,77 @@ public:
 		adsr.legato(false);
 
 
-		auto gate = addParameter("gate", 0);
-		auto freq = addParameter("freq", 1);
-		auto gain = addParameter("gain", 0.5);
+		m_gate = addParameter("gate", 0);
+		m_freq = addParameter("freq", 1);
+		m_gain = addParameter("gain", 0.5);
 
-		auto en_squ = addParameter("en_squ", 0);
-		auto en_saw = addParameter("en_saw", 1);
+		m_en_squ = addParameter("en_squ", 0);
+		m_en_saw = addParameter("en_saw", 1);
 
-		auto squ_pwm = addParameter("squ_pwm", 0.5).smoothed();
+		m_squ_pwm = addParameter("squ_pwm", 0.5);
 
-		auto attack = addParameter("attack", 0.25);
-		auto decay = addParameter("decay", 0.25);
-		auto sustain = addParameter("sustain", 0.5);
-		auto release = addParameter("release", 0.25);
+		m_attack = addParameter("attack", 0.25);
+		m_decay = addParameter("decay", 0.25);
+		m_sustain = addParameter("sustain", 0.5);
+		m_release = addParameter("release", 0.25);
 
-		osc_squ.freq(freq);
-		osc_saw.freq(freq);
+		osc_squ.freq(m_freq);
+		osc_saw.freq(m_freq);
 
-		osc_squ.pwm(squ_pwm);
+		osc_squ.pwm(m_squ_pwm.smoothed());
 
 
-		adsr.attack(attack);
-		adsr.decay(decay);
-		adsr.sustain(sustain);
-		adsr.release(release);
+		adsr.attack(m_attack);
+		adsr.decay(m_decay);
+		adsr.sustain(m_sustain);
+		adsr.release(m_release);
 
-		adsr.trigger(gate);
+		adsr.trigger(m_gate);
 
-		auto osc = osc_squ * en_squ + osc_saw * en_saw;
+		auto osc = osc_squ * m_en_squ + osc_saw * m_en_saw;
 
-		auto x = (osc * gain) * adsr;
+		auto x = (osc * m_gain) * adsr;
 
 		setOutputGen(x);
 	}
 
-	void update_params(bool init = false)
-	{
-		float osctype = round(m_preset->load()->get(dsynth_param_id::osctype));
+	// the patch is pushed every block, it's applied only when its version
+	// differs from the one the voice has
 
-		if (osctype == 0)
-		{
-			setParameter("en_squ", 1);
-			setParameter("en_saw", 0);
-		}
-		else
+	void update(const voicepatch &patch, uint32_t version)
+	{
+		if (version == m_version)
 		{
-			setParameter("en_squ", 0);
-			setParameter("en_saw", 1);
+			return;
 		}
 
-		setParameter("squ_pwm", m_preset->load()->get(pwm));
-
-		if (init)
-		{
-			setParameter("attack", m_preset->load()->get(attack));
-			setParameter("decay", m_preset->load()->get(decay));
-			setParameter("sustain", m_preset->load()->get(sustain));
-			setParameter("release", m_preset->load()->get(dsynth_param_id::release));
-		}
+		m_version = version;
+		m_en_squ.value(patch.square ? 1 : 0);
+		m_en_saw.value(patch.square ? 0 : 1);
+		m_squ_pwm.value(patch.pwm);
 	}
 
 
-	void start(int note, int, float gain, std::atomic<preset_t *> *p) 
+	void start(int note, int, float gain, const voicepatch &patch, uint32_t version) 
 	{
-		m_preset = p;
-		update_params(true);
+		m_version = version - 1;
+		update(patch, version);
+
+		m_attack.value(patch.attack);
+		m_decay.value(patch.decay);
+		m_sustain.value(patch.sustain);
+		m_release.value(patch.release);
 
 		m_note = note;
-		setParameter("freq", 440.0 * std::pow(2.0, (note - 69.0) / 12.0));
-		setParameter("gate", 1);
-		setParameter("gain", gain);
+		m_freq.value(440.0 * std::pow(2.0, (note - 69.0) / 12.0));
+		m_gate.value(1);
+		m_gain.value(gain);
 		m_held = true;
 	}
 
 	void release(int velocity) 
 	{		
-		setParameter("gate", 0);
+		m_gate.value(0);
 		m_held = false;
 	}
 
@@ -194,8 +211,6 @@ public:
 
 	void process(float **outs, int nframes)
 	{
-		update_params();
-
 		fillBufferOfFloats(outs[0], nframes, 1);
 		std::copy(outs[0], outs[0] + nframes, outs[1]);
 
@@ -212,9 +227,11 @@ private:
 	int m_note;
 	bool m_held {false};
 	float m_level {0};
+	uint32_t m_version {0};
 
-	std::atomic<preset_t *> *m_preset {nullptr};
-
+	Tonic::ControlParameter m_gate, m_freq, m_gain;
+	Tonic::ControlParameter m_en_squ, m_en_saw, m_squ_pwm;
+	Tonic::ControlParameter m_attack, m_decay, m_sustain, m_release;
 };
 
 
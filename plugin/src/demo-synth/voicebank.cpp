@@ -0,0 +1,501 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <math.h>
+#include <algorithm>
+
+#include "voicebank.h"
+
+// the lanes are split in sse halves where avx is not enabled, passing them
+// between the static functions here is fine
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+namespace demo {
+
+// the envelope ends at -80 dB, decay and release are linear in dB
+static const float level_floor = 0.0001f;
+
+// the tonic voice smooths the pwm over 50 ms
+static const float pwm_time = 0.05f;
+
+// a stolen voice fades in 5 ms, chosen among the 4 oldest
+static const float steal_fade = 0.005f;
+static const int steal_candidates = 4;
+
+
+static inline lanes_t splat(float v)
+{
+	return lanes_t {} + v;
+}
+
+static inline lanemask_t splat(voicestage s)
+{
+	return lanemask_t {} + int32_t(s);
+}
+
+// the correction of a naive step for a phase t that just wrapped or is about to
+
+static inline lanes_t polyblep(lanes_t t, lanes_t dt, lanes_t inv_dt)
+{
+	lanes_t a = t * inv_dt;
+	lanes_t b = (t - 1) * inv_dt;
+
+	lanes_t rise = a + a - a * a - 1;
+	lanes_t fall = b * b + b + b + 1;
+
+	return t < dt ? rise : (t > 1 - dt ? fall : splat(0));
+}
+
+
+void voicebank::configure(uint32_t samplerate, uint32_t voices, uint32_t maxframes)
+{
+	m_samplerate = samplerate;
+	m_voices = std::max(1u, voices);
+	m_pwm_coef = expf(-1.f / (pwm_time * samplerate));
+
+	// one group of spare lanes at least
+	uint32_t lanes = (m_voices + 2 * VOICE_LANES - 1) / VOICE_LANES * VOICE_LANES;
+
+	m_groups.resize(lanes / VOICE_LANES);
+	m_live.resize(m_groups.size());
+	m_sounding.reserve(m_groups.size());
+
+	for (auto &mix : m_mix)
+	{
+		mix.resize(std::max(1u, maxframes));
+	}
+
+	m_note.resize(m_voices);
+	m_held.resize(m_voices);
+	m_release.resize(m_voices);
+	m_next_free.resize(m_voices);
+	m_older.resize(m_voices);
+	m_newer.resize(m_voices);
+	m_spare.reserve(lanes - m_voices);
+
+	reset();
+}
+
+void voicebank::reset()
+{
+	for (auto &g : m_groups)
+	{
+		g = voicegroup {};
+		g.inc = splat(0);
+		g.inv_inc = splat(1);
+		g.pwm = splat(0.5f);
+		g.mul = splat(1);
+		g.decay_mul = splat(1);
+	}
+
+	std::fill(m_live.begin(), m_live.end(), 0);
+	std::fill(m_note.begin(), m_note.end(), -1);
+	std::fill(m_held.begin(), m_held.end(), false);
+	std::fill(m_note_voice, m_note_voice + VOICE_NOTES, -1);
+
+	// the lowest voices first, they fill the first groups
+	for (uint32_t i = 0; i < m_voices; ++i)
+	{
+		m_next_free[i] = i + 1 < m_voices ? i + 1 : -1;
+	}
+
+	m_free = 0;
+	m_oldest = m_newest = -1;
+	m_active = 0;
+
+	m_spare.clear();
+	for (uint32_t i = m_groups.size() * VOICE_LANES; i > m_voices; --i)
+	{
+		m_spare.push_back(i - 1);
+	}
+
+	m_fading = 0;
+}
+
+void voicebank::link(int index)
+{
+	m_older[index] = m_newest;
+	m_newer[index] = -1;
+
+	if (m_newest >= 0)
+	{
+		m_newer[m_newest] = index;
+	}
+	else
+	{
+		m_oldest = index;
+	}
+
+	m_newest = index;
+	++m_active;
+}
+
+void voicebank::unlink(int index)
+{
+	int older = m_older[index];
+	int newer = m_newer[index];
+
+	(older >= 0 ? m_newer[older] : m_oldest) = newer;
+	(newer >= 0 ? m_older[newer] : m_newest) = older;
+	--m_active;
+}
+
+void voicebank::note_on(int note, float gain, const voiceparams &p, float pwm)
+{
+	if (note < 0 || note >= VOICE_NOTES)
+	{
+		return;
+	}
+
+	// the same key again: the old voice lets go
+	if (m_note_voice[note] >= 0)
+	{
+		note_off(note);
+	}
+
+	int index = m_free;
+
+	if (index >= 0)
+	{
+		m_free = m_next_free[index];
+	}
+	else
+	{
+		index = steal();
+		unlink(index);
+	}
+
+	start(index, note, gain, p, pwm);
+	link(index);
+}
+
+void voicebank::note_off(int note)
+{
+	if (note < 0 || note >= VOICE_NOTES || m_note_voice[note] < 0)
+	{
+		return;
+	}
+
+	int index = m_note_voice[note];
+	m_note_voice[note] = -1;
+	m_held[index] = false;
+
+	release(index, m_release[index]);
+}
+
+// the quietest of the oldest few, released voices are usually among them. its
+// sound goes on in a spare lane for a few ms, or stops dead if none is left.
+
+int voicebank::steal()
+{
+	int victim = m_oldest;
+	float quietest = 2;
+
+	for (int i = m_oldest, n = 0; i >= 0 && n < steal_candidates; i = m_newer[i], ++n)
+	{
+		float level = m_groups[i / VOICE_LANES].level[i % VOICE_LANES];
+
+		if (level < quietest)
+		{
+			quietest = level;
+			victim = i;
+		}
+	}
+
+	if (m_note[victim] >= 0 && m_note_voice[m_note[victim]] == victim)
+	{
+		m_note_voice[m_note[victim]] = -1;
+	}
+
+	if (!m_spare.empty())
+	{
+		int spare = m_spare.back();
+		m_spare.pop_back();
+
+		auto &from = m_groups[victim / VOICE_LANES];
+		auto &to = m_groups[spare / VOICE_LANES];
+		int a = victim % VOICE_LANES, b = spare % VOICE_LANES;
+
+		to.phase[b] = from.phase[a];
+		to.inc[b] = from.inc[a];
+		to.inv_inc[b] = from.inv_inc[a];
+		to.pwm[b] = from.pwm[a];
+		to.level[b] = from.level[a];
+		to.sustain[b] = from.sustain[a];
+		to.decay_mul[b] = from.decay_mul[a];
+		to.gain[b] = from.gain[a];
+		to.stage[b] = from.stage[a];
+
+		m_live[spare / VOICE_LANES] |= 1u << b;
+		++m_fading;
+
+		release(spare, steal_fade);
+	}
+
+	return victim;
+}
+
+// lanes are written one at a time, at note boundaries only
+
+void voicebank::start(int index, int note, float gain, const voiceparams &p, float pwm)
+{
+	auto &g = m_groups[index / VOICE_LANES];
+	int l = index % VOICE_LANES;
+
+	float freq = 440.f * powf(2.f, (note - 69.f) / 12.f);
+	float inc = std::min(freq / m_samplerate, 0.5f);
+
+	g.phase[l] = 0;
+	g.inc[l] = inc;
+	g.inv_inc[l] = 1.f / inc;
+	g.pwm[l] = pwm;
+
+	g.level[l] = 0;
+	g.mul[l] = 1;
+	g.add[l] = 1.f / std::max(1.f, p.attack * m_samplerate);
+	g.sustain[l] = std::max(p.sustain, level_floor);
+	g.decay_mul[l] = powf(g.sustain[l], 1.f / std::max(1.f, p.decay * m_samplerate));
+	g.gain[l] = gain;
+	g.stage[l] = stage_attack;
+
+	m_live[index / VOICE_LANES] |= 1u << l;
+
+	m_note[index] = note;
+	m_held[index] = true;
+	m_release[index] = p.release;
+	m_note_voice[note] = index;
+}
+
+void voicebank::release(int index, float seconds)
+{
+	auto &g = m_groups[index / VOICE_LANES];
+	int l = index % VOICE_LANES;
+
+	if (g.stage[l] == stage_idle)
+	{
+		return;
+	}
+
+	float level = std::max(float(g.level[l]), level_floor);
+
+	g.level[l] = level;
+	g.mul[l] = powf(level_floor / level, 1.f / std::max(1.f, seconds * m_samplerate));
+	g.add[l] = 0;
+	g.stage[l] = stage_release;
+}
+
+// the envelope of the lane reached its end
+
+void voicebank::ended(int index)
+{
+	if (index >= int(m_voices))
+	{
+		m_spare.push_back(index);
+		--m_fading;
+		return;
+	}
+
+	unlink(index);
+	m_note[index] = -1;
+
+	m_next_free[index] = m_free;
+	m_free = index;
+}
+
+// longer stretches than configured are rendered in pieces
+
+void voicebank::render(float **outs, uint32_t from, uint32_t to, bool square, float pwm, float scale)
+{
+	uint32_t maxframes = m_mix[0].size();
+
+	while (to - from > maxframes)
+	{
+		render(outs, from, from + maxframes, square, pwm, scale);
+		from += maxframes;
+	}
+
+	if (from >= to)
+	{
+		return;
+	}
+
+	m_sounding.clear();
+
+	for (uint32_t k = 0; k < m_groups.size(); ++k)
+	{
+		if (m_live[k])
+		{
+			m_sounding.push_back(k);
+		}
+	}
+
+	m_nframes = to - from;
+	m_square = square;
+	m_pwm = pwm;
+
+	uint32_t slices = m_sounding.size() / VOICE_JOB_GROUPS;
+	slices = m_jobs ? std::min({slices, m_jobs->count_threads(), uint32_t(VOICE_JOBS)}) : 1;
+	m_slices = std::max(1u, slices);
+
+	if (m_slices > 1)
+	{
+		m_jobs->run_jobs(render_slice, this, m_slices);
+	}
+	else
+	{
+		render_slice(this, 0);
+	}
+
+	auto &mix = m_mix[0];
+
+	for (uint32_t s = 1; s < m_slices; ++s)
+	{
+		for (uint32_t i = 0; i < m_nframes; ++i)
+		{
+			mix[i] += m_mix[s][i];
+		}
+	}
+
+	// the voices that ended go back to the free list, on this thread
+
+	for (auto k : m_sounding)
+	{
+		auto &g = m_groups[k];
+		uint32_t live = 0;
+
+		for (int l = 0; l < VOICE_LANES; ++l)
+		{
+			live |= uint32_t(g.stage[l] != stage_idle) << l;
+		}
+
+		for (uint32_t gone = m_live[k] & ~live; gone; gone &= gone - 1)
+		{
+			ended(k * VOICE_LANES + __builtin_ctz(gone));
+		}
+
+		m_live[k] = live;
+	}
+
+	// one horizontal sum per frame, for all the groups together
+
+	for (uint32_t i = 0; i < m_nframes; ++i)
+	{
+		float sum = 0;
+
+		for (int l = 0; l < VOICE_LANES; ++l)
+		{
+			sum += mix[i][l];
+		}
+
+		outs[0][from + i] += sum * scale;
+		outs[1][from + i] += sum * scale;
+	}
+}
+
+// a slice of the sounding groups into its own mix, on any thread
+
+void voicebank::render_slice(void *arg, uint32_t index)
+{
+	auto _this = static_cast<voicebank *>(arg);
+	auto &mix = _this->m_mix[index];
+
+	size_t n = _this->m_sounding.size();
+	size_t first = n * index / _this->m_slices;
+	size_t last = n * (index + 1) / _this->m_slices;
+
+	std::fill(mix.begin(), mix.begin() + _this->m_nframes, lanes_t {});
+
+	for (size_t k = first; k < last; ++k)
+	{
+		auto &g = _this->m_groups[_this->m_sounding[k]];
+		_this->render_group(g, mix.data(), _this->m_nframes, _this->m_square, _this->m_pwm);
+	}
+}
+
+void voicebank::render_group(voicegroup &g, lanes_t *mix, uint32_t nframes, bool square, float pwm)
+{
+	// the state lives in registers for the block
+
+	lanes_t phase = g.phase, inc = g.inc, inv_inc = g.inv_inc;
+	lanes_t width = g.pwm, level = g.level, mul = g.mul, add = g.add;
+	lanemask_t stage = g.stage;
+
+	const lanes_t target = splat(pwm);
+	const lanes_t coef = splat(m_pwm_coef);
+	const lanes_t one = splat(1), zero = splat(0), floor = splat(level_floor);
+	const lanes_t sustain = g.sustain, decay_mul = g.decay_mul, gain = g.gain;
+	const lanemask_t idle = splat(stage_idle), attack = splat(stage_attack), decay = splat(stage_decay);
+	const lanemask_t hold = splat(stage_sustain), release = splat(stage_release);
+
+	for (uint32_t i = 0; i < nframes; ++i)
+	{
+		lanes_t osc;
+
+		if (square)
+		{
+			width = target + (width - target) * coef;
+
+			lanes_t t2 = phase - width;
+			t2 = t2 < 0 ? t2 + 1 : t2;
+
+			osc = (phase < width ? one : -one) + polyblep(phase, inc, inv_inc) - polyblep(t2, inc, inv_inc);
+		}
+		else
+		{
+			osc = phase + phase - 1 - polyblep(phase, inc, inv_inc);
+		}
+
+		mix[i] += osc * level * gain;
+
+		phase += inc;
+		phase = phase >= 1 ? phase - 1 : phase;
+
+		// the envelope, and the end of its stages
+
+		level = level * mul + add;
+
+		lanemask_t attacked = (stage == attack) & (level >= one);
+		level = attacked ? one : level;
+		mul = attacked ? decay_mul : mul;
+		add = attacked ? zero : add;
+		stage = attacked ? decay : stage;
+
+		lanemask_t decayed = (stage == decay) & (level <= sustain);
+		level = decayed ? sustain : level;
+		mul = decayed ? one : mul;
+		stage = decayed ? hold : stage;
+
+		lanemask_t released = (stage == release) & (level <= floor);
+		level = released ? zero : level;
+		mul = released ? one : mul;
+		stage = released ? idle : stage;
+	}
+
+	g.phase = phase;
+	g.pwm = width;
+	g.level = level;
+	g.mul = mul;
+	g.add = add;
+	g.stage = stage;
+}
+
+} // demo
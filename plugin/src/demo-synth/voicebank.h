@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "plum.h"
+#include "plumext.h"
+
+namespace demo {
+
+// the voices of DSynth as structures of arrays: every field holds one lane per
+// voice, and a group of VOICE_LANES voices advances with one vector operation.
+// the same sound as the tonic voice: polyblep square or saw, exponential adsr.
+// a group is as wide as the vector unit the plugin is compiled for.
+
+#ifdef __AVX__
+#define VOICE_LANES 8
+#else
+#define VOICE_LANES 4
+#endif
+
+typedef float lanes_t __attribute__((vector_size(VOICE_LANES * sizeof(float))));
+typedef int32_t lanemask_t __attribute__((vector_size(VOICE_LANES * sizeof(int32_t))));
+
+enum voicestage
+{
+	stage_idle = 0,
+	stage_attack,
+	stage_decay,
+	stage_sustain,
+	stage_release
+};
+
+struct voicegroup
+{
+	// oscillator
+	lanes_t phase;
+	lanes_t inc;			// cycles per sample
+	lanes_t inv_inc;
+	lanes_t pwm;			// smoothed towards the preset
+
+	// envelope: level = level * mul + add until the stage ends
+	lanes_t level;
+	lanes_t mul;
+	lanes_t add;
+	lanes_t sustain;
+	lanes_t decay_mul;
+	lanes_t gain;
+	lanemask_t stage;
+};
+
+struct voiceparams
+{
+	float attack;			// seconds
+	float decay;
+	float sustain;			// level
+	float release;
+};
+
+// polyphony is set at configure time. voices come from a free list and notes
+// find theirs through a map, a full bank steals the quietest of its oldest
+// voices. the stolen sound moves to a spare lane and fades out there, so the
+// new note starts at once. a voice is free again when its envelope ends.
+
+#define VOICE_NOTES 128
+
+// with the jobs of the host, the sounding groups are split in up to
+// VOICE_JOBS slices rendered in parallel, each at least VOICE_JOB_GROUPS long
+#define VOICE_JOBS 8
+#define VOICE_JOB_GROUPS 4
+
+class voicebank
+{
+public:
+	void configure(uint32_t samplerate, uint32_t voices, uint32_t maxframes);
+	void reset();
+
+	uint32_t size() const { return m_voices; }
+
+	// null renders on the calling thread
+	void set_jobs(plum::ijobs *jobs) { m_jobs = jobs; }
+	uint32_t count_active() const { return m_active + m_fading; }
+
+	void note_on(int note, float gain, const voiceparams &p, float pwm);
+	void note_off(int note);
+
+	// adds the sum of the voices times scale to both channels. square or saw for
+	// all, pwm is where the square voices glide to.
+	void render(float **outs, uint32_t from, uint32_t to, bool square, float pwm, float scale);
+
+private:
+	void render_group(voicegroup &g, lanes_t *mix, uint32_t nframes, bool square, float pwm);
+	static void render_slice(void *arg, uint32_t index);
+
+	void start(int index, int note, float gain, const voiceparams &p, float pwm);
+	void release(int index, float seconds);
+	int steal();
+	void ended(int index);
+
+	// the active voices from the oldest to the newest
+	void link(int index);
+	void unlink(int index);
+
+	uint32_t m_samplerate {48000};
+	uint32_t m_voices {0};
+	float m_pwm_coef {0};
+
+	std::vector<voicegroup> m_groups;
+	std::vector<uint32_t> m_live;		// lanes of each group with a running envelope
+
+	// the groups of one render and a mix, lane by lane, for each slice of them
+	plum::ijobs *m_jobs {nullptr};
+	std::vector<uint32_t> m_sounding;
+	std::vector<lanes_t> m_mix[VOICE_JOBS];
+	uint32_t m_slices {1};
+	uint32_t m_nframes {0};
+	bool m_square {false};
+	float m_pwm {0};
+
+	std::vector<int> m_note;
+	std::vector<bool> m_held;
+	std::vector<float> m_release;		// seconds, taken at the start like the attack
+
+	int m_note_voice[VOICE_NOTES];
+	std::vector<int> m_next_free;
+	int m_free {-1};
+
+	std::vector<int> m_older, m_newer;
+	int m_oldest {-1};
+	int m_newest {-1};
+	uint32_t m_active {0};
+
+	// the lanes after the voices, where stolen voices fade
+	std::vector<int> m_spare;
+	uint32_t m_fading {0};
+};
+
+} // demo